@@ -0,0 +1,925 @@
+// Набор бенчмарков поискового сервера на синтетическом корпусе.
+//
+// Сборка: цель search_server_benchmark в CMakeLists.txt.
+//
+// Запуск:
+//   ./search_server_benchmark --docs 10000,100000,1000000 --queries 2000 --seed 42
+//
+// Каждая строка вывода — отдельный JSON-объект (JSON Lines).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark_utils.h"
+#include "corpus_generator.h"
+#include "../durable_search_server.h"
+#include "../search_server.h"
+#include "../request_queue.h"
+#include "../paginator.h"
+#include "../search_cursor.h"
+#include "../simd.h"
+
+using namespace std;
+
+namespace {
+
+struct BenchmarkConfig {
+    vector<size_t> document_counts = {10000, 100000};
+    size_t query_count = 1000;
+    uint64_t seed = 42;
+    size_t vocabulary_size = 50000;
+    size_t threads = max(1u, thread::hardware_concurrency());
+    string filter;
+};
+
+vector<size_t> ParseSizeList(const string& text) {
+    vector<size_t> values;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t comma = text.find(',', pos);
+        if (comma == string::npos) {
+            comma = text.size();
+        }
+        values.push_back(stoull(text.substr(pos, comma - pos)));
+        pos = comma + 1;
+    }
+    return values;
+}
+
+BenchmarkConfig ParseArguments(int argc, char** argv) {
+    BenchmarkConfig config;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw invalid_argument("missing value for "s + arg);
+        }
+        const string value = argv[++i];
+        if (arg == "--docs"s) {
+            config.document_counts = ParseSizeList(value);
+        } else if (arg == "--queries"s) {
+            config.query_count = stoull(value);
+        } else if (arg == "--seed"s) {
+            config.seed = stoull(value);
+        } else if (arg == "--vocabulary"s) {
+            config.vocabulary_size = stoull(value);
+        } else if (arg == "--threads"s) {
+            config.threads = max<size_t>(1, stoull(value));
+        } else if (arg == "--filter"s) {
+            config.filter = value;
+        } else {
+            throw invalid_argument("unknown option "s + arg);
+        }
+    }
+    return config;
+}
+
+struct Corpus {
+    vector<string> stop_words;
+    vector<string> documents;
+    vector<vector<int>> ratings;
+    vector<DocumentStatus> statuses;
+    vector<string> queries;
+};
+
+Corpus MakeCorpus(const BenchmarkConfig& config, size_t document_count) {
+    CorpusGenerator::Options options;
+    options.seed = config.seed;
+    options.vocabulary_size = config.vocabulary_size;
+    CorpusGenerator generator(options);
+
+    Corpus corpus;
+    corpus.stop_words = generator.GetStopWords();
+    corpus.documents.reserve(document_count);
+    corpus.ratings.reserve(document_count);
+    corpus.statuses.reserve(document_count);
+    for (size_t i = 0; i < document_count; ++i) {
+        corpus.documents.push_back(generator.GenerateDocument());
+        corpus.ratings.push_back(generator.GenerateRatings());
+        corpus.statuses.push_back(generator.GenerateStatus());
+    }
+    corpus.queries.reserve(config.query_count);
+    for (size_t i = 0; i < config.query_count; ++i) {
+        corpus.queries.push_back(generator.GenerateQuery(1 + i % 5, i % 3 == 0 ? 1 : 0));
+    }
+    return corpus;
+}
+
+// name — имя из BenchmarkResult, которое бенчмарк выводит
+bool Enabled(const BenchmarkConfig& config, const string& name) {
+    return config.filter.empty() || name.find(config.filter) != string::npos;
+}
+
+bool Enabled(const BenchmarkConfig& config, initializer_list<string> names) {
+    return any_of(names.begin(), names.end(), [&config](const string& name) {
+        return Enabled(config, name);
+    });
+}
+
+// Индекс строится и для других бенчмарков, замер выводится, только если выбран AddDocument
+unique_ptr<SearchServer> BenchmarkAddDocument(const BenchmarkConfig& config, const Corpus& corpus) {
+    auto server = make_unique<SearchServer>(corpus.stop_words);
+    size_t bytes = 0;
+    Stopwatch stopwatch;
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        server->AddDocument(static_cast<int>(i), corpus.documents[i], corpus.statuses[i], corpus.ratings[i]);
+        bytes += corpus.documents[i].size();
+    }
+    BenchmarkResult result{"AddDocument"s};
+    result.operations = corpus.documents.size();
+    result.elapsed = stopwatch.Elapsed();
+    result.Label("documents", corpus.documents.size())
+          .Metric("bytes_per_sec", bytes * 1e9 / max<int64_t>(1, result.elapsed.count()));
+    if (Enabled(config, result.name)) {
+        PrintResult(cout, result);
+    }
+    return server;
+}
+
+void BenchmarkFindTopDocumentsSequential(const SearchServer& server, const Corpus& corpus) {
+    vector<chrono::nanoseconds> samples;
+    samples.reserve(corpus.queries.size());
+    Stopwatch total;
+    for (const string& query : corpus.queries) {
+        Stopwatch stopwatch;
+        DoNotOptimize(server.FindTopDocuments(query));
+        samples.push_back(stopwatch.Elapsed());
+    }
+    BenchmarkResult result{"FindTopDocuments"s};
+    result.operations = corpus.queries.size();
+    result.elapsed = total.Elapsed();
+    result.Label("variant", "sequential"s)
+          .Label("documents", corpus.documents.size())
+          .Label("k", MAX_RESULT_DOCUMENT_COUNT);
+    AddLatencyMetrics(result, samples);
+    PrintResult(cout, result);
+}
+
+void BenchmarkFindTopDocumentsParallel(const SearchServer& server, const Corpus& corpus, size_t threads) {
+    // Запросы делятся между потоками; сервер только читается, поэтому это безопасно
+    Stopwatch total;
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&server, &corpus, t, threads] {
+            for (size_t i = t; i < corpus.queries.size(); i += threads) {
+                DoNotOptimize(server.FindTopDocuments(corpus.queries[i]));
+            }
+        });
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    BenchmarkResult result{"FindTopDocuments"s};
+    result.operations = corpus.queries.size();
+    result.elapsed = total.Elapsed();
+    result.Label("variant", "parallel"s)
+          .Label("documents", corpus.documents.size())
+          .Label("threads", threads)
+          .Label("k", MAX_RESULT_DOCUMENT_COUNT);
+    PrintResult(cout, result);
+}
+
+// Приём документов через журнал при разных политиках fsync. Усиление записи —
+// байты журнала (и снимка) на байт текста документов.
+void BenchmarkDurableIngest(const BenchmarkConfig& config, const Corpus& corpus) {
+    constexpr size_t MAX_DOCUMENTS = 20000;
+    const size_t document_count = min(MAX_DOCUMENTS, corpus.documents.size());
+    size_t document_bytes = 0;
+    for (size_t i = 0; i < document_count; ++i) {
+        document_bytes += corpus.documents[i].size();
+    }
+    const string directory = (filesystem::temp_directory_path() / "search_server_benchmark_wal"s).string();
+    const pair<string, WalSyncPolicy> policies[] = {
+        {"none"s, WalSyncPolicy::NONE},
+        {"group_commit"s, WalSyncPolicy::GROUP_COMMIT},
+        {"every_record"s, WalSyncPolicy::EVERY_RECORD},
+    };
+    if (Enabled(config, "DurableIngest"s)) {
+        for (const auto& [policy_name, policy] : policies) {
+            filesystem::remove_all(directory);
+            WalOptions options;
+            options.sync_policy = policy;
+            {
+                SearchServer server(corpus.stop_words);
+                DurableSearchServer durable(server, directory, options);
+                Stopwatch stopwatch;
+                for (size_t i = 0; i < document_count; ++i) {
+                    durable.AddDocument(static_cast<int>(i), corpus.documents[i], corpus.statuses[i], corpus.ratings[i]);
+                }
+                durable.Commit();
+                const auto ingest_elapsed = stopwatch.Elapsed();
+                const WalStats wal_stats = durable.GetWalStats();
+                durable.Checkpoint();
+
+                BenchmarkResult result{"DurableIngest"s};
+                result.operations = document_count;
+                result.elapsed = ingest_elapsed;
+                result.Label("sync_policy", policy_name)
+                      .Label("documents", document_count)
+                      .Metric("commits", wal_stats.commits)
+                      .Metric("syncs", wal_stats.syncs)
+                      .Metric("wal_bytes", wal_stats.bytes_written)
+                      .Metric("wal_write_amplification", static_cast<double>(wal_stats.bytes_written) / document_bytes)
+                      .Metric("checkpoint_write_amplification",
+                              static_cast<double>(wal_stats.bytes_written + durable.GetSnapshotBytesWritten())
+                                  / document_bytes);
+                PrintResult(cout, result);
+            }
+        }
+    }
+
+    // Восстановление: снимок с половиной документов и журнал с остальными
+    filesystem::remove_all(directory);
+    if (!Enabled(config, "DurableRecovery"s)) {
+        return;
+    }
+    {
+        SearchServer server(corpus.stop_words);
+        DurableSearchServer durable(server, directory, WalOptions{WalSyncPolicy::NONE});
+        for (size_t i = 0; i < document_count; ++i) {
+            if (i == document_count / 2) {
+                durable.Checkpoint();
+            }
+            durable.AddDocument(static_cast<int>(i), corpus.documents[i], corpus.statuses[i], corpus.ratings[i]);
+        }
+    }
+    Stopwatch stopwatch;
+    SearchServer server(corpus.stop_words);
+    DurableSearchServer durable(server, directory);
+    BenchmarkResult result{"DurableRecovery"s};
+    result.operations = document_count;
+    result.elapsed = stopwatch.Elapsed();
+    result.Label("documents", document_count)
+          .Metric("snapshot_documents", durable.GetRecoveryStats().snapshot_documents)
+          .Metric("replayed_records", durable.GetRecoveryStats().replayed_records);
+    PrintResult(cout, result);
+    filesystem::remove_all(directory);
+}
+
+// Память прямого индекса и цена операций, которым он нужен, в каждом режиме
+void BenchmarkForwardIndex(const Corpus& corpus) {
+    const pair<string, ForwardIndexMode> modes[] = {
+        {"full"s, ForwardIndexMode::FULL},
+        {"compact"s, ForwardIndexMode::COMPACT},
+        {"none"s, ForwardIndexMode::NONE},
+    };
+    constexpr size_t SAMPLE_DOCUMENTS = 1000;
+    const size_t step = max<size_t>(1, corpus.documents.size() / SAMPLE_DOCUMENTS);
+    for (const auto& [mode_name, mode] : modes) {
+        IndexOptions options;
+        options.forward_index = mode;
+        SearchServer server(corpus.stop_words, options);
+        size_t postings = 0;
+        for (size_t i = 0; i < corpus.documents.size(); ++i) {
+            server.AddDocument(static_cast<int>(i), corpus.documents[i], corpus.statuses[i], corpus.ratings[i]);
+        }
+        server.WaitForMerges();
+        for (size_t i = 0; i < corpus.documents.size(); i += step) {
+            postings += server.CollectWordFrequencies(static_cast<int>(i)).size();
+        }
+        const size_t memory = server.GetMemoryStats().forward_index_bytes;
+
+        // В режиме FULL частоты читаются без копирования, в остальных собираются
+        const bool stored = mode == ForwardIndexMode::FULL;
+        Stopwatch lookup;
+        size_t lookups = 0;
+        for (size_t i = 0; i < corpus.documents.size(); i += step, ++lookups) {
+            if (stored) {
+                DoNotOptimize(server.GetWordFrequencies(static_cast<int>(i)));
+            } else {
+                DoNotOptimize(server.CollectWordFrequencies(static_cast<int>(i)));
+            }
+        }
+        BenchmarkResult lookup_result{"ForwardIndex"s};
+        lookup_result.operations = lookups;
+        lookup_result.elapsed = lookup.Elapsed();
+        lookup_result.Label("operation", stored ? "GetWordFrequencies"s : "CollectWordFrequencies"s)
+                     .Label("mode", mode_name)
+                     .Label("documents", corpus.documents.size())
+                     .Metric("forward_index_bytes", memory)
+                     .Metric("bytes_per_document", static_cast<double>(memory) / corpus.documents.size())
+                     .Metric("sampled_words_per_document", static_cast<double>(postings) / lookups);
+        PrintResult(cout, lookup_result);
+
+        Stopwatch remove;
+        size_t removed = 0;
+        for (size_t i = 0; i < corpus.documents.size(); i += step, ++removed) {
+            server.RemoveDocument(static_cast<int>(i));
+        }
+        BenchmarkResult remove_result{"ForwardIndex"s};
+        remove_result.operations = removed;
+        remove_result.elapsed = remove.Elapsed();
+        remove_result.Label("operation", "RemoveDocument"s)
+                     .Label("mode", mode_name)
+                     .Label("documents", corpus.documents.size());
+        PrintResult(cout, remove_result);
+    }
+}
+
+// Один корпус в трёх устройствах индекса: только изменяемый сегмент, сегменты
+// со слиянием в AddDocument и сегменты со слиянием в фоновом потоке
+void BenchmarkSegmentedIndex(const Corpus& corpus) {
+    const pair<string, IndexOptions> variants[] = {
+        {"memtable"s, IndexOptions{0, 4, false}},
+        {"segmented_sync"s, IndexOptions{4096, 4, false}},
+        {"segmented_background"s, IndexOptions{4096, 4, true}},
+    };
+    for (const auto& [variant, options] : variants) {
+        SearchServer server(corpus.stop_words, options);
+        Stopwatch ingest;
+        for (size_t i = 0; i < corpus.documents.size(); ++i) {
+            server.AddDocument(static_cast<int>(i), corpus.documents[i], corpus.statuses[i], corpus.ratings[i]);
+        }
+        const auto add_elapsed = ingest.Elapsed();
+        server.WaitForMerges();
+        BenchmarkResult add_result{"SegmentedIndex"s};
+        add_result.operations = corpus.documents.size();
+        add_result.elapsed = ingest.Elapsed();
+        add_result.Label("operation", "AddDocument"s)
+                  .Label("variant", variant)
+                  .Label("documents", corpus.documents.size())
+                  .Metric("add_ns", static_cast<double>(add_elapsed.count()))
+                  .Metric("segments", server.GetSegmentCount());
+        PrintResult(cout, add_result);
+
+        vector<chrono::nanoseconds> samples;
+        samples.reserve(corpus.queries.size());
+        Stopwatch search;
+        for (const string& query : corpus.queries) {
+            Stopwatch stopwatch;
+            DoNotOptimize(server.FindTopDocuments(query));
+            samples.push_back(stopwatch.Elapsed());
+        }
+        BenchmarkResult search_result{"SegmentedIndex"s};
+        search_result.operations = corpus.queries.size();
+        search_result.elapsed = search.Elapsed();
+        search_result.Label("operation", "FindTopDocuments"s)
+                     .Label("variant", variant)
+                     .Label("documents", corpus.documents.size());
+        AddLatencyMetrics(search_result, samples);
+        PrintResult(cout, search_result);
+
+        // Удаляется каждый десятый документ; в сегментах это только tombstone
+        Stopwatch remove;
+        size_t removed = 0;
+        for (size_t i = 0; i < corpus.documents.size(); i += 10, ++removed) {
+            server.RemoveDocument(static_cast<int>(i));
+        }
+        server.WaitForMerges();
+        BenchmarkResult remove_result{"SegmentedIndex"s};
+        remove_result.operations = removed;
+        remove_result.elapsed = remove.Elapsed();
+        remove_result.Label("operation", "RemoveDocument"s)
+                     .Label("variant", variant)
+                     .Label("documents", corpus.documents.size());
+        PrintResult(cout, remove_result);
+    }
+}
+
+// Точность частот в сегментах: память вхождений, скорость поиска и расхождение
+// с точными частотами (совпадение первых MAX_RESULT_DOCUMENT_COUNT документов и
+// наибольшая ошибка релевантности), а также пропускная способность ядер подсчёта
+void BenchmarkTermFreqPrecision(const Corpus& corpus) {
+    const pair<string, TermFreqPrecision> precisions[] = {
+        {"double"s, TermFreqPrecision::DOUBLE},
+        {"float"s, TermFreqPrecision::FLOAT},
+        {"quantized"s, TermFreqPrecision::QUANTIZED},
+    };
+    vector<vector<Document>> exact_results;
+    for (const auto& [precision_name, precision] : precisions) {
+        IndexOptions options;
+        options.term_freq_precision = precision;
+        SearchServer server(corpus.stop_words, options);
+        for (size_t i = 0; i < corpus.documents.size(); ++i) {
+            server.AddDocument(static_cast<int>(i), corpus.documents[i], corpus.statuses[i], corpus.ratings[i]);
+        }
+        server.WaitForMerges();
+
+        vector<vector<Document>> results;
+        results.reserve(corpus.queries.size());
+        vector<chrono::nanoseconds> samples;
+        samples.reserve(corpus.queries.size());
+        Stopwatch search;
+        for (const string& query : corpus.queries) {
+            Stopwatch stopwatch;
+            results.push_back(server.FindTopDocuments(query));
+            samples.push_back(stopwatch.Elapsed());
+        }
+        const auto elapsed = search.Elapsed();
+        if (exact_results.empty()) {
+            exact_results = results;
+        }
+        size_t same_order = 0;
+        double max_relevance_error = 0.0;
+        for (size_t i = 0; i < results.size(); ++i) {
+            const vector<Document>& expected = exact_results[i];
+            same_order += equal(results[i].begin(), results[i].end(), expected.begin(), expected.end(),
+                [](const Document& lhs, const Document& rhs) {
+                    return lhs.id == rhs.id;
+                });
+            for (size_t j = 0; j < min(results[i].size(), expected.size()); ++j) {
+                if (results[i][j].id == expected[j].id) {
+                    max_relevance_error = max(max_relevance_error,
+                                              abs(results[i][j].relevance - expected[j].relevance));
+                }
+            }
+        }
+        const IndexMemoryStats stats = server.GetMemoryStats();
+        BenchmarkResult result{"TermFreqPrecision"s};
+        result.operations = corpus.queries.size();
+        result.elapsed = elapsed;
+        result.Label("operation", "FindTopDocuments"s)
+              .Label("precision", precision_name)
+              .Label("documents", corpus.documents.size())
+              .Metric("postings_bytes", stats.postings_bytes)
+              .Metric("bytes_per_posting", static_cast<double>(stats.postings_bytes) / max<size_t>(1, stats.postings))
+              .Metric("same_top_fraction", static_cast<double>(same_order) / max<size_t>(1, results.size()))
+              .Metric("max_relevance_error", max_relevance_error);
+        AddLatencyMetrics(result, samples);
+        PrintResult(cout, result);
+    }
+
+    // Одно длинное слово на всех документах: вклады считаются блоками, как в поиске
+    IndexSegment::MutablePostings postings;
+    set<int> document_ids;
+    auto& word_postings = postings["word"s];
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        word_postings[static_cast<int>(i)] = 1.0 / (1 + i % 50);
+        document_ids.insert(static_cast<int>(i));
+    }
+    constexpr size_t BLOCK_SIZE = 128;
+    constexpr size_t ROUNDS = 20;
+    vector<double> scores(BLOCK_SIZE);
+    for (const auto& [precision_name, precision] : precisions) {
+        const IndexSegment segment(postings, document_ids, precision);
+        const PostingSpan span = segment.FindPostings("word"s);
+        for (const SimdLevel level : {SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2}) {
+            if (ClampSimdLevel(level) != level) {
+                continue;
+            }
+            Stopwatch stopwatch;
+            for (size_t round = 0; round < ROUNDS; ++round) {
+                for (size_t first = 0; first < span.size(); first += BLOCK_SIZE) {
+                    span.ComputeScores(first, min(BLOCK_SIZE, span.size() - first), 2.5, scores.data(), level);
+                    DoNotOptimize(scores.data());
+                }
+            }
+            BenchmarkResult result{"TermFreqPrecision"s};
+            result.operations = ROUNDS * span.size();
+            result.elapsed = stopwatch.Elapsed();
+            result.Label("operation", "ComputeScores"s)
+                  .Label("precision", precision_name)
+                  .Label("simd", string(ToString(level)))
+                  .Label("documents", corpus.documents.size());
+            PrintResult(cout, result);
+        }
+    }
+}
+
+// Журнал запросов делится на пакеты; запросы с Ципфовым распределением слов
+// естественно пересекаются по популярным словам. term_sharing — сколько
+// вхождений плюс-слов в пакете приходится на одно различное слово.
+void BenchmarkBatchQueries(const SearchServer& server, const Corpus& corpus) {
+    vector<SearchServer::PreparedQuery> queries;
+    queries.reserve(corpus.queries.size());
+    for (const string& query : corpus.queries) {
+        queries.push_back(server.PrepareQuery(query));
+    }
+    for (const size_t batch_size : {1, 16, 64, 256}) {
+        size_t term_occurrences = 0;
+        size_t distinct_terms = 0;
+        for (size_t first = 0; first < corpus.queries.size(); first += batch_size) {
+            set<string> batch_terms;
+            for (size_t i = first; i < min(first + batch_size, corpus.queries.size()); ++i) {
+                for (const string& word : SplitIntoWords(corpus.queries[i])) {
+                    if (word[0] != '-') {
+                        ++term_occurrences;
+                        batch_terms.insert(word);
+                    }
+                }
+            }
+            distinct_terms += batch_terms.size();
+        }
+
+        Stopwatch separate;
+        for (const auto& query : queries) {
+            DoNotOptimize(server.FindTopDocuments(query));
+        }
+        const auto separate_elapsed = separate.Elapsed();
+
+        Stopwatch shared;
+        for (size_t first = 0; first < queries.size(); first += batch_size) {
+            const vector<SearchServer::PreparedQuery> batch(queries.begin() + first,
+                queries.begin() + min(first + batch_size, queries.size()));
+            DoNotOptimize(server.FindTopDocumentsBatch(batch));
+        }
+        const auto shared_elapsed = shared.Elapsed();
+
+        for (const auto& [variant, elapsed] : {pair{"per_query"s, separate_elapsed}, pair{"shared_scan"s, shared_elapsed}}) {
+            BenchmarkResult result{"FindTopDocumentsBatch"s};
+            result.operations = queries.size();
+            result.elapsed = elapsed;
+            result.Label("variant", variant)
+                  .Label("batch_size", batch_size)
+                  .Label("documents", corpus.documents.size())
+                  .Metric("term_sharing", static_cast<double>(term_occurrences) / max<size_t>(1, distinct_terms));
+            PrintResult(cout, result);
+        }
+    }
+}
+
+// Полнота считается как доля документов полной выдачи, попавших в урезанную
+void BenchmarkBudgetedSearch(const SearchServer& server, const Corpus& corpus) {
+    vector<SearchServer::PreparedQuery> queries;
+    vector<set<int>> full_results;
+    queries.reserve(corpus.queries.size());
+    for (const string& query : corpus.queries) {
+        queries.push_back(server.PrepareQuery(query));
+        set<int> ids;
+        for (const Document& document : server.FindTopDocuments(queries.back())) {
+            ids.insert(document.id);
+        }
+        full_results.push_back(move(ids));
+    }
+
+    const auto run = [&](const string& variant, const string& limit, const function<SearchBudget()>& make_budget) {
+        vector<chrono::nanoseconds> samples;
+        samples.reserve(queries.size());
+        size_t partial = 0;
+        size_t found = 0;
+        size_t expected = 0;
+        Stopwatch total;
+        for (size_t i = 0; i < queries.size(); ++i) {
+            Stopwatch stopwatch;
+            const auto response = server.FindTopDocumentsWithBudget(queries[i], make_budget());
+            samples.push_back(stopwatch.Elapsed());
+            partial += response.partial ? 1 : 0;
+            for (const Document& document : response.documents) {
+                found += full_results[i].count(document.id);
+            }
+            expected += full_results[i].size();
+        }
+        BenchmarkResult result{"FindTopDocumentsWithBudget"s};
+        result.operations = queries.size();
+        result.elapsed = total.Elapsed();
+        result.Label("variant", variant)
+              .Label("limit", limit)
+              .Label("documents", corpus.documents.size());
+        AddLatencyMetrics(result, samples);
+        result.Metric("partial_fraction", static_cast<double>(partial) / max<size_t>(1, queries.size()))
+              .Metric("recall", static_cast<double>(found) / max<size_t>(1, expected));
+        PrintResult(cout, result);
+    };
+
+    run("unlimited"s, "none"s, [] {
+        return SearchBudget{};
+    });
+    for (const size_t max_postings : {10000, 1000, 100}) {
+        run("postings"s, to_string(max_postings), [max_postings] {
+            SearchBudget budget;
+            budget.max_postings = max_postings;
+            return budget;
+        });
+    }
+    for (const int deadline_us : {100, 20}) {
+        run("deadline"s, to_string(deadline_us) + "us"s, [deadline_us] {
+            SearchBudget budget;
+            budget.deadline = chrono::steady_clock::now() + chrono::microseconds(deadline_us);
+            return budget;
+        });
+    }
+}
+
+// Один и тот же запрос выполняется со всеми статусами: строкой и подготовленным
+void BenchmarkPreparedQueries(const BenchmarkConfig& config, const SearchServer& server, const Corpus& corpus) {
+    const DocumentStatus statuses[] = {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT,
+                                       DocumentStatus::BANNED, DocumentStatus::REMOVED};
+    const bool find_enabled = Enabled(config, "FindTopDocuments"s);
+    const auto report = [&](const string& variant, size_t operations, chrono::nanoseconds elapsed) {
+        BenchmarkResult result{"FindTopDocuments"s};
+        result.operations = operations;
+        result.elapsed = elapsed;
+        result.Label("variant", variant)
+              .Label("documents", corpus.documents.size())
+              .Label("k", MAX_RESULT_DOCUMENT_COUNT);
+        PrintResult(cout, result);
+    };
+    if (find_enabled) {
+        Stopwatch stopwatch;
+        for (const string& query : corpus.queries) {
+            for (const DocumentStatus status : statuses) {
+                DoNotOptimize(server.FindTopDocuments(query, status));
+            }
+        }
+        report("raw_by_status"s, corpus.queries.size() * size(statuses), stopwatch.Elapsed());
+    }
+    vector<SearchServer::PreparedQuery> prepared_queries;
+    prepared_queries.reserve(corpus.queries.size());
+    {
+        Stopwatch stopwatch;
+        for (const string& query : corpus.queries) {
+            prepared_queries.push_back(server.PrepareQuery(query));
+        }
+        BenchmarkResult result{"PrepareQuery"s};
+        result.operations = corpus.queries.size();
+        result.elapsed = stopwatch.Elapsed();
+        result.Label("documents", corpus.documents.size());
+        if (Enabled(config, result.name)) {
+            PrintResult(cout, result);
+        }
+    }
+    if (find_enabled) {
+        Stopwatch stopwatch;
+        for (const auto& query : prepared_queries) {
+            for (const DocumentStatus status : statuses) {
+                DoNotOptimize(server.FindTopDocuments(query, status));
+            }
+        }
+        report("prepared_by_status"s, prepared_queries.size() * size(statuses), stopwatch.Elapsed());
+    }
+}
+
+// Листание выдачи курсором: страница N+1 продолжает с последнего документа страницы N
+void BenchmarkSearchCursor(const SearchServer& server, const Corpus& corpus) {
+    const size_t query_count = min<size_t>(corpus.queries.size(), 200);
+    for (const size_t page_size : {5, 10, 100}) {
+        for (const size_t page_count : {1, 10}) {
+            size_t returned = 0;
+            Stopwatch stopwatch;
+            for (size_t i = 0; i < query_count; ++i) {
+                auto cursor = MakeSearchCursor(server, corpus.queries[i], page_size);
+                for (size_t page = 0; page < page_count && !cursor.IsExhausted(); ++page) {
+                    returned += cursor.NextPage().size();
+                }
+            }
+            BenchmarkResult result{"SearchCursor"s};
+            result.operations = query_count;
+            result.elapsed = stopwatch.Elapsed();
+            result.Label("documents", corpus.documents.size())
+                  .Label("k", page_size)
+                  .Label("pages", page_count)
+                  .Metric("documents_returned", returned);
+            PrintResult(cout, result);
+        }
+    }
+}
+
+void BenchmarkMatchDocument(const SearchServer& server, const Corpus& corpus) {
+    const size_t document_count = corpus.documents.size();
+    Stopwatch stopwatch;
+    for (size_t i = 0; i < corpus.queries.size(); ++i) {
+        const int document_id = static_cast<int>((i * 7919) % document_count);
+        DoNotOptimize(server.MatchDocument(corpus.queries[i], document_id));
+    }
+    BenchmarkResult result{"MatchDocument"s};
+    result.operations = corpus.queries.size();
+    result.elapsed = stopwatch.Elapsed();
+    result.Label("documents", document_count);
+    PrintResult(cout, result);
+}
+
+void BenchmarkRequestQueue(const SearchServer& server, const Corpus& corpus) {
+    RequestQueue request_queue(server);
+    // Больше суток запросов, чтобы очередь начала вытеснять старые
+    const size_t operations = max<size_t>(corpus.queries.size(), 2000);
+    Stopwatch stopwatch;
+    for (size_t i = 0; i < operations; ++i) {
+        DoNotOptimize(request_queue.AddFindRequest(corpus.queries[i % corpus.queries.size()]));
+    }
+    BenchmarkResult result{"RequestQueue.AddFindRequest"s};
+    result.operations = operations;
+    result.elapsed = stopwatch.Elapsed();
+    result.Label("documents", corpus.documents.size())
+          .Metric("no_result_requests", request_queue.GetNoResultRequests())
+          .Metric("memory_bytes", request_queue.GetMemoryUsage());
+    PrintResult(cout, result);
+}
+
+// Разбивка памяти индекса и цена самого вызова GetMemoryStats
+void BenchmarkMemoryStats(const SearchServer& server, const Corpus& corpus) {
+    constexpr size_t CALLS = 1000;
+    Stopwatch stopwatch;
+    for (size_t i = 0; i < CALLS; ++i) {
+        DoNotOptimize(server.GetMemoryStats());
+    }
+    const IndexMemoryStats stats = server.GetMemoryStats();
+    BenchmarkResult result{"GetMemoryStats"s};
+    result.operations = CALLS;
+    result.elapsed = stopwatch.Elapsed();
+    result.Label("documents", corpus.documents.size())
+          .Metric("total_bytes", stats.GetTotalBytes())
+          .Metric("term_dictionary_bytes", stats.term_dictionary_bytes)
+          .Metric("postings_bytes", stats.postings_bytes)
+          .Metric("forward_index_bytes", stats.forward_index_bytes)
+          .Metric("document_table_bytes", stats.document_table_bytes)
+          .Metric("stop_words_bytes", stats.stop_words_bytes)
+          .Metric("tombstone_bytes", stats.tombstone_bytes)
+          .Metric("terms", stats.terms)
+          .Metric("postings", stats.postings)
+          .Metric("segments", stats.segments)
+          .Metric("average_posting_length", stats.average_posting_length);
+    PrintResult(cout, result);
+}
+
+// Прежняя реализация: посимвольное разбиение и отдельный проход IsValidWord
+size_t LegacySplitAndValidate(const string& text) {
+    vector<string> words;
+    string word;
+    for (const char c : text) {
+        if (c == ' ') {
+            if (!word.empty()) {
+                words.push_back(word);
+                word.clear();
+            }
+        } else {
+            word += c;
+        }
+    }
+    if (!word.empty()) {
+        words.push_back(word);
+    }
+    size_t invalid = 0;
+    for (const string& w : words) {
+        invalid += !IsValidWord(w);
+    }
+    return words.size() + invalid;
+}
+
+// Документы токенизируются по одному, как при индексации
+void BenchmarkTokenizer(const Corpus& corpus) {
+    size_t bytes = 0;
+    for (const string& document : corpus.documents) {
+        bytes += document.size();
+    }
+    const auto report = [&](const string& variant, chrono::nanoseconds elapsed) {
+        BenchmarkResult result{"TokenizeText"s};
+        result.operations = corpus.documents.size();
+        result.elapsed = elapsed;
+        result.Label("variant", variant)
+              .Label("bytes", bytes)
+              .Metric("gb_per_sec", static_cast<double>(bytes) / max<int64_t>(1, elapsed.count()));
+        PrintResult(cout, result);
+    };
+
+    {
+        Stopwatch stopwatch;
+        for (const string& document : corpus.documents) {
+            DoNotOptimize(LegacySplitAndValidate(document));
+        }
+        report("legacy"s, stopwatch.Elapsed());
+    }
+    for (const SimdLevel level : {SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2}) {
+        if (ClampSimdLevel(level) != level) {
+            continue;
+        }
+        Stopwatch stopwatch;
+        for (const string& document : corpus.documents) {
+            DoNotOptimize(TokenizeText(document, level));
+        }
+        report(ToString(level), stopwatch.Elapsed());
+    }
+}
+
+// Проверка токенов документов по списку из нескольких сотен стоп-слов
+void BenchmarkStopWords(const BenchmarkConfig& config) {
+    CorpusGenerator::Options options;
+    options.seed = config.seed;
+    options.vocabulary_size = config.vocabulary_size;
+    options.stop_word_count = 300;
+    CorpusGenerator generator(options);
+    const vector<string> stop_words = generator.GetStopWords();
+    vector<string> tokens;
+    for (size_t i = 0; i < 1000000; ++i) {
+        tokens.push_back(generator.GetWord(generator.SampleRank()));
+    }
+
+    const auto run = [&](const string& variant, const auto& contains) {
+        size_t found = 0;
+        Stopwatch stopwatch;
+        for (const string& token : tokens) {
+            found += contains(token);
+        }
+        BenchmarkResult result{"IsStopWord"s};
+        result.operations = tokens.size();
+        result.elapsed = stopwatch.Elapsed();
+        result.Label("variant", variant)
+              .Label("stop_words", stop_words.size())
+              .Metric("hit_rate", static_cast<double>(found) / tokens.size());
+        PrintResult(cout, result);
+    };
+
+    const set<string, less<>> stop_word_set(stop_words.begin(), stop_words.end());
+    run("set"s, [&](string_view word) {
+        return stop_word_set.count(word) > 0;
+    });
+    const StopWords perfect_hash(stop_word_set);
+    run("perfect_hash"s, [&](string_view word) {
+        return perfect_hash.Contains(word);
+    });
+}
+
+template <typename Container>
+void BenchmarkPaginate(const string& container_name, const Container& document_ids) {
+    for (const size_t page_size : {10, 1000}) {
+        Stopwatch stopwatch;
+        const auto pages = Paginate(document_ids, page_size);
+        size_t visited = 0;
+        size_t page_count = 0;
+        for (const auto& page : pages) {
+            visited += page.size();
+            ++page_count;
+        }
+        DoNotOptimize(visited);
+        BenchmarkResult result{"Paginate"s};
+        result.operations = page_count;
+        result.elapsed = stopwatch.Elapsed();
+        result.Label("container", container_name)
+              .Label("documents", document_ids.size())
+              .Label("page_size", page_size);
+        PrintResult(cout, result);
+    }
+}
+
+void BenchmarkPaginator(SearchServer& server) {
+    BenchmarkPaginate("vector"s, vector<int>(server.begin(), server.end()));
+    BenchmarkPaginate("list"s, list<int>(server.begin(), server.end()));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    try {
+        const BenchmarkConfig config = ParseArguments(argc, argv);
+        if (Enabled(config, "TokenizeText"s)) {
+            BenchmarkTokenizer(MakeCorpus(config, 200000));
+        }
+        if (Enabled(config, "IsStopWord"s)) {
+            BenchmarkStopWords(config);
+        }
+        for (const size_t document_count : config.document_counts) {
+            const Corpus corpus = MakeCorpus(config, document_count);
+            // Общий индекс строится, только если он нужен хоть одному выбранному бенчмарку
+            unique_ptr<SearchServer> server;
+            if (Enabled(config, {"AddDocument"s, "FindTopDocuments"s, "FindTopDocumentsBatch"s,
+                                 "FindTopDocumentsWithBudget"s, "PrepareQuery"s, "SearchCursor"s, "MatchDocument"s,
+                                 "RequestQueue.AddFindRequest"s, "GetMemoryStats"s, "Paginate"s})) {
+                server = BenchmarkAddDocument(config, corpus);
+            }
+            if (Enabled(config, "FindTopDocuments"s)) {
+                BenchmarkFindTopDocumentsSequential(*server, corpus);
+                BenchmarkFindTopDocumentsParallel(*server, corpus, config.threads);
+            }
+            if (Enabled(config, {"FindTopDocuments"s, "PrepareQuery"s})) {
+                BenchmarkPreparedQueries(config, *server, corpus);
+            }
+            if (Enabled(config, "SearchCursor"s)) {
+                BenchmarkSearchCursor(*server, corpus);
+            }
+            if (Enabled(config, "FindTopDocumentsBatch"s)) {
+                BenchmarkBatchQueries(*server, corpus);
+            }
+            if (Enabled(config, "FindTopDocumentsWithBudget"s)) {
+                BenchmarkBudgetedSearch(*server, corpus);
+            }
+            if (Enabled(config, "SegmentedIndex"s)) {
+                BenchmarkSegmentedIndex(corpus);
+            }
+            if (Enabled(config, {"DurableIngest"s, "DurableRecovery"s})) {
+                BenchmarkDurableIngest(config, corpus);
+            }
+            if (Enabled(config, "ForwardIndex"s)) {
+                BenchmarkForwardIndex(corpus);
+            }
+            if (Enabled(config, "TermFreqPrecision"s)) {
+                BenchmarkTermFreqPrecision(corpus);
+            }
+            if (Enabled(config, "MatchDocument"s)) {
+                BenchmarkMatchDocument(*server, corpus);
+            }
+            if (Enabled(config, "RequestQueue.AddFindRequest"s)) {
+                BenchmarkRequestQueue(*server, corpus);
+            }
+            if (Enabled(config, "GetMemoryStats"s)) {
+                BenchmarkMemoryStats(*server, corpus);
+            }
+            if (Enabled(config, "Paginate"s)) {
+                BenchmarkPaginator(*server);
+            }
+        }
+    } catch (const exception& e) {
+        cerr << "benchmark failed: "s << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
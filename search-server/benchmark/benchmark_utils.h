@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Результат одного замера. Печатается одной строкой JSON (JSON Lines),
+// чтобы результаты разных коммитов можно было сравнивать скриптом.
+struct BenchmarkResult {
+    std::string name;
+    // Значения уже отформатированы как JSON
+    std::vector<std::pair<std::string, std::string>> labels;
+    size_t operations = 0;
+    std::chrono::nanoseconds elapsed{0};
+    std::vector<std::pair<std::string, double>> metrics;
+
+    explicit BenchmarkResult(std::string name)
+        : name(std::move(name)) {
+    }
+
+    BenchmarkResult& Label(const std::string& key, const std::string& value) {
+        labels.emplace_back(key, "\"" + value + "\"");
+        return *this;
+    }
+
+    BenchmarkResult& Label(const std::string& key, uint64_t value) {
+        labels.emplace_back(key, std::to_string(value));
+        return *this;
+    }
+
+    BenchmarkResult& Metric(const std::string& key, double value) {
+        metrics.emplace_back(key, value);
+        return *this;
+    }
+};
+
+inline void PrintResult(std::ostream& out, const BenchmarkResult& result) {
+    const double elapsed_ns = static_cast<double>(result.elapsed.count());
+    std::ostringstream line;
+    line << "{\"name\":\"" << result.name << "\"";
+    for (const auto& [key, value] : result.labels) {
+        line << ",\"" << key << "\":" << value;
+    }
+    line << ",\"operations\":" << result.operations
+         << ",\"elapsed_ns\":" << result.elapsed.count();
+    if (result.operations > 0) {
+        line << ",\"ns_per_op\":" << elapsed_ns / result.operations;
+    }
+    if (elapsed_ns > 0) {
+        line << ",\"ops_per_sec\":" << result.operations * 1e9 / elapsed_ns;
+    }
+    for (const auto& [key, value] : result.metrics) {
+        line << ",\"" << key << "\":" << value;
+    }
+    line << "}";
+    out << line.str() << std::endl;
+}
+
+class Stopwatch {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    std::chrono::nanoseconds Elapsed() const {
+        return Clock::now() - start_;
+    }
+
+private:
+    Clock::time_point start_ = Clock::now();
+};
+
+// Перцентиль по уже измеренным длительностям отдельных операций
+inline double Percentile(std::vector<std::chrono::nanoseconds> samples, double percentile) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    const size_t index = std::min(samples.size() - 1,
+                                  static_cast<size_t>(percentile / 100.0 * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return static_cast<double>(samples[index].count());
+}
+
+inline void AddLatencyMetrics(BenchmarkResult& result, const std::vector<std::chrono::nanoseconds>& samples) {
+    result.Metric("p50_ns", Percentile(samples, 50))
+          .Metric("p99_ns", Percentile(samples, 99))
+          .Metric("max_ns", Percentile(samples, 100));
+}
+
+// Не даёт компилятору выбросить вычисление, результат которого не используется
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
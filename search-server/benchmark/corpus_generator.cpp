@@ -0,0 +1,116 @@
+#include "corpus_generator.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+// Биективная запись в 26-ричной системе: 0 -> "a", 25 -> "z", 26 -> "aa", ...
+// Сдвиг на 26 * 26 делает все слова не короче трёх букв.
+string MakeWord(size_t rank) {
+    size_t n = rank + 26 * 26 + 1;
+    string word;
+    while (n > 0) {
+        --n;
+        word += static_cast<char>('a' + n % 26);
+        n /= 26;
+    }
+    reverse(word.begin(), word.end());
+    return word;
+}
+
+}  // namespace
+
+CorpusGenerator::CorpusGenerator(const Options& options)
+    : options_(options), engine_(options.seed) {
+    vocabulary_.reserve(options_.vocabulary_size);
+    cumulative_weights_.reserve(options_.vocabulary_size);
+    double total = 0.0;
+    for (size_t rank = 0; rank < options_.vocabulary_size; ++rank) {
+        vocabulary_.push_back(MakeWord(rank));
+        total += 1.0 / pow(static_cast<double>(rank + 1), options_.zipf_exponent);
+        cumulative_weights_.push_back(total);
+    }
+    for (double& weight : cumulative_weights_) {
+        weight /= total;
+    }
+}
+
+vector<string> CorpusGenerator::GetStopWords() const {
+    const size_t count = min(options_.stop_word_count, vocabulary_.size());
+    return {vocabulary_.begin(), vocabulary_.begin() + count};
+}
+
+string CorpusGenerator::GenerateDocument() {
+    const size_t word_count = NextInRange(options_.min_document_words, options_.max_document_words);
+    string document;
+    for (size_t i = 0; i < word_count; ++i) {
+        if (i > 0) {
+            document += ' ';
+        }
+        document += vocabulary_[SampleRank()];
+    }
+    return document;
+}
+
+vector<int> CorpusGenerator::GenerateRatings() {
+    const size_t count = NextInRange(1, 5);
+    vector<int> ratings;
+    ratings.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        ratings.push_back(static_cast<int>(NextInRange(0, 20)) - 10);
+    }
+    return ratings;
+}
+
+DocumentStatus CorpusGenerator::GenerateStatus() {
+    // 85% ACTUAL, остальные статусы поровну
+    const size_t roll = NextInRange(0, 99);
+    if (roll < 85) {
+        return DocumentStatus::ACTUAL;
+    } else if (roll < 90) {
+        return DocumentStatus::IRRELEVANT;
+    } else if (roll < 95) {
+        return DocumentStatus::BANNED;
+    }
+    return DocumentStatus::REMOVED;
+}
+
+string CorpusGenerator::GenerateQuery(size_t plus_words, size_t minus_words) {
+    string query;
+    for (size_t i = 0; i < plus_words + minus_words; ++i) {
+        if (i > 0) {
+            query += ' ';
+        }
+        if (i >= plus_words) {
+            query += '-';
+        }
+        query += vocabulary_[SampleRank()];
+    }
+    return query;
+}
+
+const string& CorpusGenerator::GetWord(size_t rank) const {
+    return vocabulary_.at(rank);
+}
+
+size_t CorpusGenerator::SampleRank() {
+    const double u = NextUniform();
+    const auto it = upper_bound(cumulative_weights_.begin(), cumulative_weights_.end(), u);
+    return min(static_cast<size_t>(it - cumulative_weights_.begin()), vocabulary_.size() - 1);
+}
+
+uint64_t CorpusGenerator::NextRandom() {
+    return engine_();
+}
+
+double CorpusGenerator::NextUniform() {
+    // 53 старших бита -> [0, 1)
+    return static_cast<double>(engine_() >> 11) * 0x1.0p-53;
+}
+
+size_t CorpusGenerator::NextInRange(size_t min_value, size_t max_value) {
+    return min_value + static_cast<size_t>(engine_() % (max_value - min_value + 1));
+}
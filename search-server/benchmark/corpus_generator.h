@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../document.h"
+
+// Детерминированный генератор синтетического корпуса: слова словаря
+// выбираются по закону Ципфа, поэтому частоты похожи на естественный текст.
+// Одинаковый seed даёт одинаковые документы и запросы на любой платформе.
+class CorpusGenerator {
+public:
+    struct Options {
+        uint64_t seed = 42;
+        size_t vocabulary_size = 50000;
+        double zipf_exponent = 1.0;
+        size_t min_document_words = 5;
+        size_t max_document_words = 40;
+        size_t stop_word_count = 100;
+    };
+
+    explicit CorpusGenerator(const Options& options);
+
+    // Самые частые слова словаря, как это обычно и бывает со стоп-словами
+    std::vector<std::string> GetStopWords() const;
+
+    std::string GenerateDocument();
+    std::vector<int> GenerateRatings();
+    DocumentStatus GenerateStatus();
+
+    // Запрос из plus_words слов и minus_words слов с префиксом '-'
+    std::string GenerateQuery(size_t plus_words, size_t minus_words);
+
+    const std::string& GetWord(size_t rank) const;
+    size_t SampleRank();
+    uint64_t NextRandom();
+
+private:
+    Options options_;
+    std::mt19937_64 engine_;
+    std::vector<std::string> vocabulary_;
+    std::vector<double> cumulative_weights_;
+
+    // В отличие от std::uniform_*_distribution даёт одинаковый результат
+    // во всех реализациях стандартной библиотеки
+    double NextUniform();
+    size_t NextInRange(size_t min_value, size_t max_value);
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+using namespace std;
+
+// Двоичная запись снимков и журнала: целые числа в little-endian,
+// строки с префиксом длины, контрольная сумма CRC-32 (IEEE 802.3).
+namespace binary_io {
+
+constexpr array<uint32_t, 256> MakeCrc32Table() {
+    array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+inline constexpr array<uint32_t, 256> CRC32_TABLE = MakeCrc32Table();
+
+inline uint32_t Crc32(string_view data) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (const char c : data) {
+        crc = CRC32_TABLE[(crc ^ static_cast<unsigned char>(c)) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+template <typename Integer>
+void AppendInteger(string& output, Integer value) {
+    const auto bits = static_cast<make_unsigned_t<Integer>>(value);
+    for (size_t byte = 0; byte < sizeof(Integer); ++byte) {
+        output.push_back(static_cast<char>((bits >> (8 * byte)) & 0xFF));
+    }
+}
+
+inline void AppendDouble(string& output, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    AppendInteger(output, bits);
+}
+
+inline void AppendString(string& output, string_view value) {
+    AppendInteger(output, static_cast<uint32_t>(value.size()));
+    output.append(value);
+}
+
+// Читает значения из буфера по порядку; выход за границу буфера — out_of_range
+class Reader {
+public:
+    explicit Reader(string_view data) : data_(data) {}
+
+    template <typename Integer>
+    Integer ReadInteger() {
+        const string_view bytes = ReadBytes(sizeof(Integer));
+        make_unsigned_t<Integer> bits = 0;
+        for (size_t byte = 0; byte < sizeof(Integer); ++byte) {
+            bits |= static_cast<make_unsigned_t<Integer>>(static_cast<unsigned char>(bytes[byte])) << (8 * byte);
+        }
+        return static_cast<Integer>(bits);
+    }
+
+    double ReadDouble() {
+        const uint64_t bits = ReadInteger<uint64_t>();
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    string_view ReadString() {
+        return ReadBytes(ReadInteger<uint32_t>());
+    }
+
+    string_view ReadBytes(size_t size) {
+        if (size > data_.size() - position_) {
+            throw out_of_range("unexpected end of binary data"s);
+        }
+        const string_view bytes = data_.substr(position_, size);
+        position_ += size;
+        return bytes;
+    }
+
+    size_t GetPosition() const {
+        return position_;
+    }
+
+    bool AtEnd() const {
+        return position_ == data_.size();
+    }
+
+private:
+    string_view data_;
+    size_t position_ = 0;
+};
+
+}  // namespace binary_io
@@ -0,0 +1,108 @@
+#include "durable_search_server.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "binary_io.h"
+
+using namespace std;
+
+namespace {
+
+constexpr string_view SNAPSHOT_MAGIC = "SSSNAP01"sv;
+
+string PrepareDirectory(const string& directory) {
+    filesystem::create_directories(directory);
+    return directory;
+}
+
+}  // namespace
+
+DurableSearchServer::DurableSearchServer(SearchServer& server, const string& directory, const WalOptions& options)
+    : server_(server), snapshot_path_(PrepareDirectory(directory) + "/search_server.snapshot"s),
+      recovery_stats_(Recover(directory + "/search_server.wal"s)),
+      log_(directory + "/search_server.wal"s, options) {
+}
+
+void DurableSearchServer::AddDocument(int document_id, const string& document, DocumentStatus status,
+                                      const vector<int>& ratings) {
+    server_.AddDocument(document_id, document, status, ratings);
+    try {
+        log_.Append({sequence_ + 1, WalRecordType::ADD_DOCUMENT, document_id, status, ratings, document});
+    } catch (...) {
+        // Записи нет в журнале — сервер не должен опережать его
+        server_.RemoveDocument(document_id);
+        throw;
+    }
+    ++sequence_;
+}
+
+// Удаление не проверяет id и не бросает, поэтому сначала пишется в журнал
+void DurableSearchServer::RemoveDocument(int document_id) {
+    log_.Append({sequence_ + 1, WalRecordType::REMOVE_DOCUMENT, document_id, DocumentStatus::ACTUAL, {}, {}});
+    ++sequence_;
+    server_.RemoveDocument(document_id);
+}
+
+void DurableSearchServer::Commit() {
+    log_.Commit();
+}
+
+// Формат снимка: сигнатура, номер последней вошедшей записи журнала,
+// CRC-32 и снимок SearchServer
+void DurableSearchServer::Checkpoint() {
+    log_.Commit();
+    string body;
+    server_.SaveSnapshot(body);
+    string snapshot(SNAPSHOT_MAGIC);
+    binary_io::AppendInteger(snapshot, sequence_);
+    binary_io::AppendInteger(snapshot, binary_io::Crc32(body));
+    snapshot += body;
+    WriteFileAtomically(snapshot_path_, snapshot);
+    snapshot_bytes_written_ += snapshot.size();
+    // Если упасть здесь, записи журнала не старше sequence_ при восстановлении пропускаются
+    log_.Reset();
+}
+
+RecoveryStats DurableSearchServer::Recover(const string& wal_path) {
+    if (server_.GetDocumentCount() > 0) {
+        throw invalid_argument("durable search server must be recovered into an empty search server"s);
+    }
+    RecoveryStats stats;
+    ifstream input(snapshot_path_, ios::binary);
+    if (input) {
+        const string snapshot{istreambuf_iterator<char>(input), istreambuf_iterator<char>()};
+        binary_io::Reader reader(snapshot);
+        if (snapshot.size() < SNAPSHOT_MAGIC.size() || reader.ReadBytes(SNAPSHOT_MAGIC.size()) != SNAPSHOT_MAGIC) {
+            throw invalid_argument("not a search server snapshot: "s + snapshot_path_);
+        }
+        stats.snapshot_sequence = reader.ReadInteger<uint64_t>();
+        const auto checksum = reader.ReadInteger<uint32_t>();
+        const string_view body = string_view(snapshot).substr(reader.GetPosition());
+        // Снимок заменяется атомарно, поэтому несовпадение означает порчу диска
+        if (binary_io::Crc32(body) != checksum) {
+            throw invalid_argument("search server snapshot is corrupted: "s + snapshot_path_);
+        }
+        server_.LoadSnapshot(body);
+        stats.snapshot_documents = server_.GetDocumentCount();
+    }
+
+    sequence_ = stats.snapshot_sequence;
+    const auto replay_stats = ReplayWriteAheadLog(wal_path, [this, &stats](const WalRecord& record) {
+        if (record.sequence <= stats.snapshot_sequence) {
+            ++stats.skipped_records;
+            return;
+        }
+        if (record.type == WalRecordType::ADD_DOCUMENT) {
+            server_.AddDocument(record.document_id, record.document, record.status, record.ratings);
+        } else {
+            server_.RemoveDocument(record.document_id);
+        }
+        sequence_ = record.sequence;
+        ++stats.replayed_records;
+    });
+    stats.truncated_bytes = replay_stats.truncated_bytes;
+    return stats;
+}
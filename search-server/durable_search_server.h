@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+#include "write_ahead_log.h"
+
+struct RecoveryStats {
+    uint64_t snapshot_documents = 0;
+    uint64_t snapshot_sequence = 0;
+    uint64_t replayed_records = 0;
+    // Записи, уже вошедшие в снимок (падение между снимком и очисткой журнала)
+    uint64_t skipped_records = 0;
+    uint64_t truncated_bytes = 0;
+};
+
+// Долговечная обёртка над SearchServer. В каталоге лежат снимок и журнал
+// предзаписи; конструктор восстанавливает сервер из снимка и дописанного
+// после него журнала. Добавление сначала применяется к серверу (ошибки
+// валидации не попадают в журнал), затем пишется в журнал и откатывается,
+// если запись не удалась. Удаление сначала пишется в журнал.
+class DurableSearchServer {
+public:
+    // server должен быть пуст
+    DurableSearchServer(SearchServer& server, const string& directory, const WalOptions& options = WalOptions());
+
+    void AddDocument(int document_id, const string& document, DocumentStatus status, const vector<int>& ratings);
+    void RemoveDocument(int document_id);
+
+    // Записывает накопленную группу, не дожидаясь её заполнения
+    void Commit();
+    // Сохраняет снимок сервера и очищает журнал
+    void Checkpoint();
+
+    const RecoveryStats& GetRecoveryStats() const {
+        return recovery_stats_;
+    }
+
+    WalStats GetWalStats() const {
+        return log_.GetStats();
+    }
+
+    uint64_t GetSnapshotBytesWritten() const {
+        return snapshot_bytes_written_;
+    }
+
+private:
+    SearchServer& server_;
+    string snapshot_path_;
+    // Номер последней записи журнала; Recover выставляет его, поэтому объявлен раньше recovery_stats_
+    uint64_t sequence_ = 0;
+    uint64_t snapshot_bytes_written_ = 0;
+    RecoveryStats recovery_stats_;
+    WriteAheadLog log_;
+
+    RecoveryStats Recover(const string& wal_path);
+};
@@ -0,0 +1,333 @@
+#include "index_segment.h"
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SEARCH_SERVER_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+constexpr double MAX_QUANTIZED_TERM_FREQ = 65535.0;
+constexpr double QUANTIZATION_STEP = 1.0 / MAX_QUANTIZED_TERM_FREQ;
+
+// Ноль не нужен: вхождение уже означает, что слово в документе есть.
+// Раскодированная частота кодируется в тот же код, так что слияние точно
+uint16_t QuantizeTermFreq(double term_freq) {
+    return static_cast<uint16_t>(clamp(round(term_freq * MAX_QUANTIZED_TERM_FREQ), 1.0, MAX_QUANTIZED_TERM_FREQ));
+}
+
+template <typename TermFreq>
+void ComputeScoresScalar(const TermFreq* term_freqs, size_t count, double weight, double* scores) {
+    for (size_t i = 0; i < count; ++i) {
+        scores[i] = static_cast<double>(term_freqs[i]) * weight;
+    }
+}
+
+#ifdef SEARCH_SERVER_X86_SIMD
+
+__attribute__((target("sse2")))
+void ComputeScoresSse2(const double* term_freqs, size_t count, double weight, double* scores) {
+    const __m128d weights = _mm_set1_pd(weight);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        _mm_storeu_pd(scores + i, _mm_mul_pd(_mm_loadu_pd(term_freqs + i), weights));
+    }
+    ComputeScoresScalar(term_freqs + i, count - i, weight, scores + i);
+}
+
+__attribute__((target("sse2")))
+void ComputeScoresSse2(const float* term_freqs, size_t count, double weight, double* scores) {
+    const __m128d weights = _mm_set1_pd(weight);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 block = _mm_loadu_ps(term_freqs + i);
+        _mm_storeu_pd(scores + i, _mm_mul_pd(_mm_cvtps_pd(block), weights));
+        _mm_storeu_pd(scores + i + 2, _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(block, block)), weights));
+    }
+    ComputeScoresScalar(term_freqs + i, count - i, weight, scores + i);
+}
+
+__attribute__((target("sse2")))
+void ComputeScoresSse2(const uint16_t* term_freqs, size_t count, double weight, double* scores) {
+    const __m128d weights = _mm_set1_pd(weight);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i block = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(term_freqs + i));
+        const __m128i values = _mm_unpacklo_epi16(block, zero);
+        _mm_storeu_pd(scores + i, _mm_mul_pd(_mm_cvtepi32_pd(values), weights));
+        _mm_storeu_pd(scores + i + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(values, 8)), weights));
+    }
+    ComputeScoresScalar(term_freqs + i, count - i, weight, scores + i);
+}
+
+__attribute__((target("avx2")))
+void ComputeScoresAvx2(const double* term_freqs, size_t count, double weight, double* scores) {
+    const __m256d weights = _mm256_set1_pd(weight);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm256_storeu_pd(scores + i, _mm256_mul_pd(_mm256_loadu_pd(term_freqs + i), weights));
+    }
+    ComputeScoresScalar(term_freqs + i, count - i, weight, scores + i);
+}
+
+__attribute__((target("avx2")))
+void ComputeScoresAvx2(const float* term_freqs, size_t count, double weight, double* scores) {
+    const __m256d weights = _mm256_set1_pd(weight);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m256d values = _mm256_cvtps_pd(_mm_loadu_ps(term_freqs + i));
+        _mm256_storeu_pd(scores + i, _mm256_mul_pd(values, weights));
+    }
+    ComputeScoresScalar(term_freqs + i, count - i, weight, scores + i);
+}
+
+__attribute__((target("avx2")))
+void ComputeScoresAvx2(const uint16_t* term_freqs, size_t count, double weight, double* scores) {
+    const __m256d weights = _mm256_set1_pd(weight);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i block = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(term_freqs + i));
+        const __m256d values = _mm256_cvtepi32_pd(_mm_cvtepu16_epi32(block));
+        _mm256_storeu_pd(scores + i, _mm256_mul_pd(values, weights));
+    }
+    ComputeScoresScalar(term_freqs + i, count - i, weight, scores + i);
+}
+
+#endif
+
+// Умножение точно по IEEE, поэтому все уровни дают одинаковые биты
+template <typename TermFreq>
+void ScaleTermFreqs(const TermFreq* term_freqs, size_t count, double weight, double* scores, SimdLevel level) {
+    switch (ClampSimdLevel(level)) {
+#ifdef SEARCH_SERVER_X86_SIMD
+        case SimdLevel::AVX2:
+            ComputeScoresAvx2(term_freqs, count, weight, scores);
+            break;
+        case SimdLevel::SSE2:
+            ComputeScoresSse2(term_freqs, count, weight, scores);
+            break;
+#endif
+        default:
+            ComputeScoresScalar(term_freqs, count, weight, scores);
+            break;
+    }
+}
+
+}  // namespace
+
+double RoundTermFreq(double term_freq, TermFreqPrecision precision) {
+    switch (precision) {
+        case TermFreqPrecision::FLOAT:
+            return static_cast<float>(term_freq);
+        case TermFreqPrecision::QUANTIZED:
+            return QuantizeTermFreq(term_freq) * QUANTIZATION_STEP;
+        default:
+            return term_freq;
+    }
+}
+
+double PostingSpan::GetTermFreq(size_t index) const {
+    switch (precision_) {
+        case TermFreqPrecision::FLOAT:
+            return static_cast<const float*>(term_freqs_)[index];
+        case TermFreqPrecision::QUANTIZED:
+            return static_cast<const uint16_t*>(term_freqs_)[index] * QUANTIZATION_STEP;
+        default:
+            return static_cast<const double*>(term_freqs_)[index];
+    }
+}
+
+size_t PostingSpan::FindDocument(int document_id) const {
+    const int* it = lower_bound(document_ids_, document_ids_ + size_, document_id);
+    return it != document_ids_ + size_ && *it == document_id ? static_cast<size_t>(it - document_ids_) : size_;
+}
+
+void PostingSpan::ComputeScores(size_t first, size_t count, double weight, double* scores) const {
+    ComputeScores(first, count, weight, scores, DetectSimdLevel());
+}
+
+void PostingSpan::ComputeScores(size_t first, size_t count, double weight, double* scores, SimdLevel level) const {
+    switch (precision_) {
+        case TermFreqPrecision::FLOAT:
+            ScaleTermFreqs(static_cast<const float*>(term_freqs_) + first, count, weight, scores, level);
+            break;
+        case TermFreqPrecision::QUANTIZED:
+            ScaleTermFreqs(static_cast<const uint16_t*>(term_freqs_) + first, count, weight * QUANTIZATION_STEP,
+                           scores, level);
+            break;
+        default:
+            ScaleTermFreqs(static_cast<const double*>(term_freqs_) + first, count, weight, scores, level);
+            break;
+    }
+}
+
+IndexSegment::IndexSegment(const MutablePostings& word_to_document_freqs, const set<int>& document_ids,
+                           TermFreqPrecision precision)
+    : precision_(precision), document_ids_(document_ids.begin(), document_ids.end()) {
+    term_offsets_.reserve(word_to_document_freqs.size() + 1);
+    posting_offsets_.reserve(word_to_document_freqs.size() + 1);
+    vector<Posting> postings;
+    for (const auto& [word, document_freqs] : word_to_document_freqs) {
+        AppendTerm(word);
+        postings.clear();
+        for (const auto [document_id, term_freq] : document_freqs) {
+            postings.push_back({document_id, term_freq});
+        }
+        AppendPostings(postings);
+    }
+    ShrinkToFit();
+}
+
+IndexSegment::IndexSegment(const vector<const IndexSegment*>& segments, const vector<const set<int>*>& tombstones,
+                           TermFreqPrecision precision)
+    : precision_(precision) {
+    const auto is_deleted = [&tombstones](size_t segment_index, int document_id) {
+        return tombstones[segment_index] != nullptr && tombstones[segment_index]->count(document_id) > 0;
+    };
+
+    for (size_t s = 0; s < segments.size(); ++s) {
+        for (const int document_id : segments[s]->document_ids_) {
+            if (!is_deleted(s, document_id)) {
+                document_ids_.push_back(document_id);
+            }
+        }
+    }
+    sort(document_ids_.begin(), document_ids_.end());
+
+    // Слияние отсортированных словарей: на каждом шаге берётся наименьшее слово
+    vector<size_t> positions(segments.size(), 0);
+    vector<Posting> merged_postings;
+    while (true) {
+        optional<string_view> word;
+        for (size_t s = 0; s < segments.size(); ++s) {
+            if (positions[s] < segments[s]->GetTermCount()) {
+                const string_view candidate = segments[s]->GetTerm(positions[s]);
+                if (!word || candidate < *word) {
+                    word = candidate;
+                }
+            }
+        }
+        if (!word) {
+            break;
+        }
+
+        merged_postings.clear();
+        size_t contributing_segments = 0;
+        for (size_t s = 0; s < segments.size(); ++s) {
+            if (positions[s] >= segments[s]->GetTermCount() || segments[s]->GetTerm(positions[s]) != *word) {
+                continue;
+            }
+            ++contributing_segments;
+            for (const Posting& posting : segments[s]->GetPostings(positions[s])) {
+                if (!is_deleted(s, posting.document_id)) {
+                    merged_postings.push_back(posting);
+                }
+            }
+            ++positions[s];
+        }
+        if (merged_postings.empty()) {
+            continue;
+        }
+        if (contributing_segments > 1) {
+            sort(merged_postings.begin(), merged_postings.end(), [](const Posting& lhs, const Posting& rhs) {
+                return lhs.document_id < rhs.document_id;
+            });
+        }
+        AppendTerm(*word);
+        AppendPostings(merged_postings);
+    }
+    ShrinkToFit();
+}
+
+PostingSpan IndexSegment::FindPostings(string_view word) const {
+    size_t first = 0;
+    size_t last = GetTermCount();
+    while (first < last) {
+        const size_t middle = first + (last - first) / 2;
+        if (GetTerm(middle) < word) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    if (first < GetTermCount() && GetTerm(first) == word) {
+        return GetPostings(first);
+    }
+    return {};
+}
+
+bool IndexSegment::ContainsDocument(int document_id) const {
+    return binary_search(document_ids_.begin(), document_ids_.end(), document_id);
+}
+
+string_view IndexSegment::GetTerm(size_t term_index) const {
+    return string_view(term_storage_).substr(term_offsets_[term_index],
+                                             term_offsets_[term_index + 1] - term_offsets_[term_index]);
+}
+
+PostingSpan IndexSegment::GetPostings(size_t term_index) const {
+    const size_t first = posting_offsets_[term_index];
+    const size_t size = posting_offsets_[term_index + 1] - first;
+    switch (precision_) {
+        case TermFreqPrecision::FLOAT:
+            return {posting_documents_.data() + first, size, precision_, float_term_freqs_.data() + first};
+        case TermFreqPrecision::QUANTIZED:
+            return {posting_documents_.data() + first, size, precision_, quantized_term_freqs_.data() + first};
+        default:
+            return {posting_documents_.data() + first, size, precision_, double_term_freqs_.data() + first};
+    }
+}
+
+size_t IndexSegment::GetDictionaryMemoryUsage() const {
+    return memory_usage::StringHeap(term_storage_) + memory_usage::VectorHeap(term_offsets_);
+}
+
+size_t IndexSegment::GetPostingsMemoryUsage() const {
+    return memory_usage::VectorHeap(posting_offsets_) + memory_usage::VectorHeap(posting_documents_)
+        + memory_usage::VectorHeap(double_term_freqs_) + memory_usage::VectorHeap(float_term_freqs_)
+        + memory_usage::VectorHeap(quantized_term_freqs_) + memory_usage::VectorHeap(document_ids_);
+}
+
+void IndexSegment::AppendTerm(string_view word) {
+    term_storage_.append(word);
+    term_offsets_.push_back(static_cast<uint32_t>(term_storage_.size()));
+}
+
+void IndexSegment::AppendPostings(const vector<Posting>& postings) {
+    for (const Posting& posting : postings) {
+        posting_documents_.push_back(posting.document_id);
+    }
+    switch (precision_) {
+        case TermFreqPrecision::FLOAT:
+            for (const Posting& posting : postings) {
+                float_term_freqs_.push_back(static_cast<float>(posting.term_freq));
+            }
+            break;
+        case TermFreqPrecision::QUANTIZED:
+            for (const Posting& posting : postings) {
+                quantized_term_freqs_.push_back(QuantizeTermFreq(posting.term_freq));
+            }
+            break;
+        default:
+            for (const Posting& posting : postings) {
+                double_term_freqs_.push_back(posting.term_freq);
+            }
+            break;
+    }
+    posting_offsets_.push_back(static_cast<uint32_t>(posting_documents_.size()));
+}
+
+void IndexSegment::ShrinkToFit() {
+    term_storage_.shrink_to_fit();
+    posting_documents_.shrink_to_fit();
+    double_term_freqs_.shrink_to_fit();
+    float_term_freqs_.shrink_to_fit();
+    quantized_term_freqs_.shrink_to_fit();
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "memory_usage.h"
+#include "simd.h"
+
+using namespace std;
+
+// Как замороженный сегмент хранит частоты слов в документах
+enum class TermFreqPrecision {
+    // Без потерь, 8 байт на вхождение
+    DOUBLE,
+    // 4 байта, относительная погрешность не больше 6e-8
+    FLOAT,
+    // 2 байта: частота (она не больше 1) с шагом 1/65535. Шаг общий для всех
+    // слов и сегментов, поэтому равные частоты дают равные коды и документы,
+    // равные по релевантности, остаются равными.
+    // Ошибка вклада слова — до 7.6e-6 * IDF, релевантности — до суммы по словам
+    // запроса (на синтетическом корпусе до 7e-5), то есть больше
+    // FLOAT_COMPARE_THRESHOLD. Документы, близкие по релевантности, могут
+    // поменяться местами относительно DOUBLE, а равенство до порога, после
+    // которого порядок решает рейтинг, — появиться или пропасть. Выдача и курсор
+    // search_after согласованы между собой: оба видят одни и те же частоты
+    QUANTIZED,
+};
+
+// Частота в том виде, в каком её вернёт сегмент с такой точностью. Нужна
+// изменяемому сегменту, чтобы его вклады совпадали с вкладами замороженных
+double RoundTermFreq(double term_freq, TermFreqPrecision precision);
+
+struct Posting {
+    int document_id;
+    double term_freq;
+};
+
+// Непрерывный участок списка вхождений, отсортированный по document_id.
+// Номера документов и частоты лежат в отдельных массивах, поэтому частоты
+// можно обрабатывать векторными инструкциями.
+class PostingSpan {
+public:
+    class Iterator {
+    public:
+        Iterator(const PostingSpan* span, size_t index) : span_(span), index_(index) {}
+
+        Posting operator*() const {
+            return {span_->GetDocumentId(index_), span_->GetTermFreq(index_)};
+        }
+
+        Iterator& operator++() {
+            ++index_;
+            return *this;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return index_ != other.index_;
+        }
+
+    private:
+        const PostingSpan* span_;
+        size_t index_;
+    };
+
+    PostingSpan() = default;
+    PostingSpan(const int* document_ids, size_t size, TermFreqPrecision precision, const void* term_freqs)
+        : document_ids_(document_ids), size_(size), precision_(precision), term_freqs_(term_freqs) {
+    }
+
+    Iterator begin() const {
+        return {this, 0};
+    }
+
+    Iterator end() const {
+        return {this, size_};
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    int GetDocumentId(size_t index) const {
+        return document_ids_[index];
+    }
+
+    double GetTermFreq(size_t index) const;
+
+    // Позиция документа в списке или size(), если его там нет
+    size_t FindDocument(int document_id) const;
+
+    bool ContainsDocument(int document_id) const {
+        return FindDocument(document_id) != size_;
+    }
+
+    // scores[i] = частота вхождения first + i, умноженная на weight (обычно IDF).
+    // Шаг квантования входит в вес слова, так что на вхождение приходится одно умножение.
+    void ComputeScores(size_t first, size_t count, double weight, double* scores) const;
+    void ComputeScores(size_t first, size_t count, double weight, double* scores, SimdLevel level) const;
+
+private:
+    const int* document_ids_ = nullptr;
+    size_t size_ = 0;
+    TermFreqPrecision precision_ = TermFreqPrecision::DOUBLE;
+    // double, float или uint16_t в зависимости от precision_
+    const void* term_freqs_ = nullptr;
+};
+
+// Неизменяемый сегмент индекса, оптимизированный для чтения: отсортированный
+// словарь в одном буфере и списки вхождений в одном массиве.
+// Сегменты получаются заморозкой изменяемого сегмента и слиянием других сегментов.
+class IndexSegment {
+public:
+    using MutablePostings = map<string, map<int, double>, less<>>;
+
+    IndexSegment(const MutablePostings& word_to_document_freqs, const set<int>& document_ids,
+                 TermFreqPrecision precision = TermFreqPrecision::DOUBLE);
+
+    // Удалённые документы (tombstones) при слиянии отбрасываются
+    IndexSegment(const vector<const IndexSegment*>& segments, const vector<const set<int>*>& tombstones,
+                 TermFreqPrecision precision = TermFreqPrecision::DOUBLE);
+
+    PostingSpan FindPostings(string_view word) const;
+    bool ContainsDocument(int document_id) const;
+
+    const vector<int>& GetDocumentIds() const {
+        return document_ids_;
+    }
+
+    size_t GetDocumentCount() const {
+        return document_ids_.size();
+    }
+
+    size_t GetTermCount() const {
+        return term_offsets_.size() - 1;
+    }
+
+    size_t GetPostingCount() const {
+        return posting_documents_.size();
+    }
+
+    TermFreqPrecision GetTermFreqPrecision() const {
+        return precision_;
+    }
+
+    string_view GetTerm(size_t term_index) const;
+    PostingSpan GetPostings(size_t term_index) const;
+
+    // Оценка занятой кучи: словарь сегмента и списки вхождений со списком документов
+    size_t GetDictionaryMemoryUsage() const;
+    size_t GetPostingsMemoryUsage() const;
+
+private:
+    string term_storage_;
+    vector<uint32_t> term_offsets_ = {0};
+    vector<uint32_t> posting_offsets_ = {0};
+    TermFreqPrecision precision_;
+    vector<int> posting_documents_;
+    // Заполнен только массив, соответствующий precision_
+    vector<double> double_term_freqs_;
+    vector<float> float_term_freqs_;
+    vector<uint16_t> quantized_term_freqs_;
+    vector<int> document_ids_;
+
+    void AppendTerm(string_view word);
+    void AppendPostings(const vector<Posting>& postings);
+    void ShrinkToFit();
+};
+
+// Сегмент вместе с множеством удалённых из него документов.
+// Множество заменяется целиком (copy-on-write), поэтому снимок списка
+// сегментов остаётся согласованным, пока его читают.
+struct SegmentEntry {
+    shared_ptr<const IndexSegment> segment;
+    shared_ptr<const set<int>> tombstones;
+
+    bool IsDeleted(int document_id) const {
+        return tombstones && tombstones->count(document_id) > 0;
+    }
+
+    size_t GetLiveDocumentCount() const {
+        return segment->GetDocumentCount() - (tombstones ? tombstones->size() : 0);
+    }
+};
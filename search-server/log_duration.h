@@ -7,7 +7,12 @@
 #define PROFILE_CONCAT(X,Y) PROFILE_CONCAT_INTERNAL(X,Y)
 #define UNIQ_VAR_NAME_PROFILE PROFILE_CONCAT(profileGuard, __LINE__)
 //#define LOG_DURATION(x) LogDuration UNIQ_VAR_NAME_PROFILE(x)
+// SEARCH_SERVER_NO_PROFILE отключает вывод профилирования (нужно для бенчмарков)
+#ifdef SEARCH_SERVER_NO_PROFILE
+#define LOG_DURATION_STREAM(x)
+#else
 #define LOG_DURATION_STREAM(x) LogDuration UNIQ_VAR_NAME_PROFILE(x)
+#endif
 
 class LogDuration {
 public:
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Оценка занятой кучи по устройству libstdc++ и glibc malloc: блок получает
+// 8 байт заголовка, выравнивается по 16 байтам и занимает не меньше 32 байт,
+// узел красно-чёрного дерева хранит 32 байта служебных полей.
+namespace memory_usage {
+
+inline size_t HeapBlock(size_t bytes) {
+    if (bytes == 0) {
+        return 0;
+    }
+    return max<size_t>(32, (bytes + 8 + 15) / 16 * 16);
+}
+
+template <typename Value>
+size_t TreeNode() {
+    return HeapBlock(32 + sizeof(Value));
+}
+
+// Короткие строки хранятся внутри объекта и кучу не занимают
+inline size_t StringHeap(const string& value) {
+    return value.capacity() > 15 ? HeapBlock(value.capacity() + 1) : 0;
+}
+
+template <typename T>
+size_t VectorHeap(const vector<T>& values) {
+    return HeapBlock(values.capacity() * sizeof(T));
+}
+
+// Только узлы дерева, без кучи, которую занимают сами значения
+template <typename Key, typename Value, typename Compare>
+size_t MapNodes(const map<Key, Value, Compare>& values) {
+    return values.size() * TreeNode<typename map<Key, Value, Compare>::value_type>();
+}
+
+template <typename Key, typename Compare>
+size_t SetNodes(const set<Key, Compare>& values) {
+    return values.size() * TreeNode<Key>();
+}
+
+}  // namespace memory_usage
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 #include <vector>
 
 template <typename Iterator>
@@ -36,51 +41,108 @@ std::ostream& operator<<(std::ostream& out, const IteratorRange<T>& ItRange) {
 
 
 
+// Страницы вычисляются по мере обхода: конструктор ничего не перебирает,
+// а каждый элемент диапазона проходится один раз, даже если итераторы
+// не поддерживают произвольный доступ.
 template <typename Iterator>
 class Paginator {
+    static constexpr bool IS_RANDOM_ACCESS = std::is_base_of_v<std::random_access_iterator_tag,
+        typename std::iterator_traits<Iterator>::iterator_category>;
+
 public:
-    Paginator(Iterator begin, Iterator end, size_t page_size) {
-        auto dist = distance(begin, end);
-        size_ = dist / page_size;
-        if (dist % page_size != 0) {
-            ++size_;
+    // Страница возвращается по значению, поэтому итератор только входной:
+    // прямому итератору нужна ссылка на хранимый элемент
+    class PageIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = IteratorRange<Iterator>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = value_type;
+
+        PageIterator(Iterator page_begin, Iterator end, size_t page_size)
+            : page_begin_(page_begin), page_end_(page_begin), end_(end), page_size_(page_size) {
+            FindPageEnd();
+        }
+
+        IteratorRange<Iterator> operator*() const {
+            return {page_begin_, page_end_, page_length_};
+        }
+
+        PageIterator& operator++() {
+            page_begin_ = page_end_;
+            FindPageEnd();
+            return *this;
         }
 
-        if (begin > end) {
-            throw invalid_argument("begin > end"s);
-        } else if (page_size == 0) {
-            throw invalid_argument("page size must be greater then 0"s);
+        PageIterator operator++(int) {
+            PageIterator prev = *this;
+            ++*this;
+            return prev;
         }
 
-        for (int i=0; i < size_; ++i) {
-            auto p_begin = next(begin, page_size * i);
-            auto p_end = next(p_begin, page_size);
-            if (p_end > end) {
-                p_end = end;
+        bool operator==(const PageIterator& other) const {
+            return page_begin_ == other.page_begin_;
+        }
+
+        bool operator!=(const PageIterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        Iterator page_begin_;
+        Iterator page_end_;
+        Iterator end_;
+        size_t page_size_;
+        size_t page_length_ = 0;
+
+        void FindPageEnd() {
+            if constexpr (IS_RANDOM_ACCESS) {
+                page_length_ = std::min(page_size_, static_cast<size_t>(end_ - page_begin_));
+                page_end_ = page_begin_ + page_length_;
+            } else {
+                page_end_ = page_begin_;
+                for (page_length_ = 0; page_length_ < page_size_ && page_end_ != end_; ++page_length_) {
+                    ++page_end_;
+                }
+            }
+        }
+    };
+
+    Paginator(Iterator begin, Iterator end, size_t page_size) : begin_(begin), end_(end), page_size_(page_size) {
+        using namespace std::literals;
+        if (page_size == 0) {
+            throw std::invalid_argument("page size must be greater then 0"s);
+        }
+        if constexpr (IS_RANDOM_ACCESS) {
+            if (begin > end) {
+                throw std::invalid_argument("begin > end"s);
             }
-            pages_.push_back({p_begin, p_end, static_cast<size_t>(distance(p_begin, p_end))});
         }
     }
 
-    auto begin() const {
-        return pages_.begin();
+    PageIterator begin() const {
+        return {begin_, end_, page_size_};
     }
 
-    auto end() const {
-        return pages_.end();
+    PageIterator end() const {
+        return {end_, end_, page_size_};
     }
 
+    // Для итераторов без произвольного доступа линейна по числу элементов
     size_t size() const {
-        return size_;
+        const auto dist = static_cast<size_t>(std::distance(begin_, end_));
+        return dist / page_size_ + (dist % page_size_ != 0 ? 1 : 0);
     }
 
 private:
-    vector<IteratorRange<Iterator>> pages_;
-    size_t size_;
-}; 
+    Iterator begin_;
+    Iterator end_;
+    size_t page_size_;
+};
 
 
 template <typename Container>
 auto Paginate(const Container& c, size_t page_size) {
-    return Paginator(begin(c), end(c), page_size);
-}
\ No newline at end of file
+    return Paginator(std::begin(c), std::end(c), page_size);
+}
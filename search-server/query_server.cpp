@@ -0,0 +1,449 @@
+#include "query_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr string_view FIND_COMMAND = "FIND "sv;
+constexpr string_view STATS_COMMAND = "STATS"sv;
+constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+constexpr int MAX_EPOLL_EVENTS = 64;
+
+[[noreturn]] void ThrowSystemError(const string& what) {
+    throw system_error(errno, generic_category(), what);
+}
+
+int OpenUnixListener(const string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw invalid_argument("unix socket path is too long: "s + path);
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.data(), path.size());
+    const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        ThrowSystemError("cannot create unix socket"s);
+    }
+    // Сокет, оставшийся от прошлого запуска, мешает bind
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listener, SOMAXCONN) != 0) {
+        const int error = errno;
+        close(listener);
+        errno = error;
+        ThrowSystemError("cannot listen on "s + path);
+    }
+    return listener;
+}
+
+int OpenTcpListener(uint16_t port, uint16_t& bound_port) {
+    const int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        ThrowSystemError("cannot create tcp socket"s);
+    }
+    const int enable = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    socklen_t address_size = sizeof(address);
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listener, SOMAXCONN) != 0
+        || getsockname(listener, reinterpret_cast<sockaddr*>(&address), &address_size) != 0) {
+        const int error = errno;
+        close(listener);
+        errno = error;
+        ThrowSystemError("cannot listen on 127.0.0.1:"s + to_string(port));
+    }
+    bound_port = ntohs(address.sin_port);
+    return listener;
+}
+
+void AddToEpoll(int epoll, int descriptor, uint64_t id, uint32_t events) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = id;
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, descriptor, &event) != 0) {
+        ThrowSystemError("cannot add descriptor to epoll"s);
+    }
+}
+
+string FormatDocuments(const vector<Document>& documents) {
+    ostringstream line;
+    line << "OK "s << documents.size();
+    for (const Document& document : documents) {
+        line << ' ' << document.id << ':' << document.relevance << ':' << document.rating;
+    }
+    return line.str();
+}
+
+}  // namespace
+
+QueryServer::FileDescriptor::~FileDescriptor() {
+    if (descriptor_ >= 0) {
+        close(descriptor_);
+    }
+}
+
+void QueryServer::FileDescriptor::Reset(int descriptor) {
+    if (descriptor_ >= 0) {
+        close(descriptor_);
+    }
+    descriptor_ = descriptor;
+}
+
+QueryServer::QueryServer(const SearchServer& server, const QueryServerOptions& options)
+    : server_(server), options_(options), request_queue_(server), pool_(options.threads) {
+    if (options_.max_batch_size == 0 || options_.max_pipeline_depth == 0) {
+        throw invalid_argument("query server batch size and pipeline depth must be positive"s);
+    }
+    listener_.Reset(options_.unix_socket_path.empty() ? OpenTcpListener(options_.tcp_port, port_)
+                                                      : OpenUnixListener(options_.unix_socket_path));
+    epoll_.Reset(epoll_create1(EPOLL_CLOEXEC));
+    if (epoll_.Get() < 0) {
+        ThrowSystemError("cannot create epoll"s);
+    }
+    wakeup_.Reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    if (wakeup_.Get() < 0) {
+        ThrowSystemError("cannot create eventfd"s);
+    }
+    AddToEpoll(epoll_.Get(), listener_.Get(), LISTENER_ID, EPOLLIN);
+    AddToEpoll(epoll_.Get(), wakeup_.Get(), WAKEUP_ID, EPOLLIN);
+}
+
+QueryServer::~QueryServer() {
+    if (!options_.unix_socket_path.empty()) {
+        unlink(options_.unix_socket_path.c_str());
+    }
+}
+
+void QueryServer::Run() {
+    epoll_event events[MAX_EPOLL_EVENTS];
+    while (!stopping_) {
+        const int count = epoll_wait(epoll_.Get(), events, MAX_EPOLL_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("epoll_wait failed"s);
+        }
+        for (int i = 0; i < count; ++i) {
+            const uint64_t id = events[i].data.u64;
+            if (id == LISTENER_ID) {
+                AcceptConnections();
+                continue;
+            }
+            if (id == WAKEUP_ID) {
+                uint64_t value;
+                while (read(wakeup_.Get(), &value, sizeof(value)) > 0) {
+                }
+                continue;
+            }
+            const auto it = connections_.find(id);
+            if (it == connections_.end()) {
+                continue;
+            }
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                // Клиент закрыл сокет целиком: ответы доставить уже некуда
+                it->second.failed = true;
+            } else if (events[i].events & EPOLLIN) {
+                ReadConnection(id, it->second);
+            }
+            if (events[i].events & EPOLLOUT) {
+                WriteConnection(it->second);
+            }
+            UpdateConnection(id);
+        }
+        // Ответы освобождают место в конвейерах, и отложенные строки тоже
+        // становятся запросами; всё готовое за проход уходит в пул пакетами
+        CollectResponses();
+        DispatchRequests();
+    }
+}
+
+void QueryServer::Stop() {
+    stopping_ = true;
+    Wake();
+}
+
+void QueryServer::Wake() {
+    const uint64_t value = 1;
+    // Переполниться счётчик eventfd не может, а ошибка означает, что цикл и так проснётся
+    [[maybe_unused]] const ssize_t written = write(wakeup_.Get(), &value, sizeof(value));
+}
+
+void QueryServer::AcceptConnections() {
+    while (true) {
+        const int socket = accept4(listener_.Get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                // Например, кончились дескрипторы: уже открытые соединения продолжают работать
+                cerr << "query server accept failed: "s << strerror(errno) << endl;
+            }
+            return;
+        }
+        if (options_.unix_socket_path.empty()) {
+            const int enable = 1;
+            setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+        const uint64_t id = next_connection_id_++;
+        Connection& connection = connections_[id];
+        connection.socket.Reset(socket);
+        connection.events = EPOLLIN;
+        AddToEpoll(epoll_.Get(), socket, id, connection.events);
+        ++stats_.connections;
+    }
+}
+
+void QueryServer::ReadConnection(uint64_t connection_id, Connection& connection) {
+    if (connection.closing || connection.failed) {
+        return;
+    }
+    char buffer[READ_BUFFER_SIZE];
+    const ssize_t received = recv(connection.socket.Get(), buffer, sizeof(buffer), 0);
+    if (received > 0) {
+        connection.input.append(buffer, static_cast<size_t>(received));
+        stats_.bytes_read += static_cast<uint64_t>(received);
+        ParseRequests(connection_id, connection);
+    } else if (received == 0) {
+        connection.closing = true;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        connection.failed = true;
+    }
+}
+
+void QueryServer::ParseRequests(uint64_t connection_id, Connection& connection) {
+    size_t position = 0;
+    while (connection.in_flight < options_.max_pipeline_depth) {
+        const size_t end = connection.input.find('\n', position);
+        if (end == string::npos) {
+            break;
+        }
+        string_view line = string_view(connection.input).substr(position, end - position);
+        position = end + 1;
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+
+        const uint64_t sequence = connection.next_sequence++;
+        ++connection.in_flight;
+        if (line.substr(0, FIND_COMMAND.size()) == FIND_COMMAND) {
+            ready_requests_.push_back({connection_id, sequence, string(line.substr(FIND_COMMAND.size()))});
+            continue;
+        }
+        Response response;
+        response.connection_id = connection_id;
+        response.sequence = sequence;
+        if (line == STATS_COMMAND) {
+            response.stats = true;
+        } else {
+            response.line = "ERROR unknown command"s;
+            response.failed = true;
+        }
+        Deliver(connection, move(response));
+    }
+    connection.input.erase(0, position);
+
+    if (connection.input.size() > options_.max_line_length && connection.input.find('\n') == string::npos) {
+        // Дальше строку не разобрать: ответить на принятые запросы и закрыть
+        Response response;
+        response.connection_id = connection_id;
+        response.sequence = connection.next_sequence++;
+        response.line = "ERROR request line is too long"s;
+        response.failed = true;
+        ++connection.in_flight;
+        Deliver(connection, move(response));
+        connection.input.clear();
+        connection.closing = true;
+    }
+}
+
+void QueryServer::DispatchRequests() {
+    for (size_t first = 0; first < ready_requests_.size(); first += options_.max_batch_size) {
+        const size_t last = min(first + options_.max_batch_size, ready_requests_.size());
+        vector<Request> batch(make_move_iterator(ready_requests_.begin() + first),
+                              make_move_iterator(ready_requests_.begin() + last));
+        pool_.Submit([this, batch = move(batch)] {
+            ExecuteBatch(batch);
+        });
+        ++stats_.batches;
+    }
+    ready_requests_.clear();
+}
+
+// Выполняется в пуле
+void QueryServer::ExecuteBatch(const vector<Request>& batch) {
+    vector<Response> responses;
+    responses.reserve(batch.size());
+    vector<SearchServer::PreparedQuery> queries;
+    vector<size_t> query_responses;
+    for (const Request& request : batch) {
+        Response response;
+        response.connection_id = request.connection_id;
+        response.sequence = request.sequence;
+        try {
+            queries.push_back(server_.PrepareQuery(request.raw_query));
+            query_responses.push_back(responses.size());
+            response.searched = true;
+            response.raw_query = request.raw_query;
+        } catch (const invalid_argument& e) {
+            response.line = "ERROR "s + e.what();
+            response.failed = true;
+        }
+        responses.push_back(move(response));
+    }
+
+    try {
+        auto results = server_.FindTopDocumentsBatch(queries);
+        for (size_t i = 0; i < results.size(); ++i) {
+            Response& response = responses[query_responses[i]];
+            response.line = FormatDocuments(results[i]);
+            response.documents = move(results[i]);
+        }
+    } catch (const exception& e) {
+        // Без ответа соединение ждало бы его вечно
+        for (const size_t index : query_responses) {
+            responses[index].line = "ERROR "s + e.what();
+            responses[index].searched = false;
+            responses[index].failed = true;
+        }
+    }
+
+    {
+        lock_guard lock(responses_mutex_);
+        move(responses.begin(), responses.end(), back_inserter(responses_));
+    }
+    Wake();
+}
+
+void QueryServer::CollectResponses() {
+    vector<Response> responses;
+    {
+        lock_guard lock(responses_mutex_);
+        responses.swap(responses_);
+    }
+    set<uint64_t> touched;
+    for (Response& response : responses) {
+        const auto it = connections_.find(response.connection_id);
+        // Соединение успело закрыться с ошибкой
+        if (it == connections_.end()) {
+            continue;
+        }
+        touched.insert(response.connection_id);
+        Deliver(it->second, move(response));
+    }
+    for (const uint64_t id : touched) {
+        Connection& connection = connections_.at(id);
+        // Освободилось место в конвейере: разобрать строки, которые уже прочитаны
+        ParseRequests(id, connection);
+        UpdateConnection(id);
+    }
+}
+
+// Ставит ответ в очередь и отправляет все ответы, которые теперь идут по порядку
+void QueryServer::Deliver(Connection& connection, Response response) {
+    --connection.in_flight;
+    connection.completed.emplace(response.sequence, move(response));
+    for (auto it = connection.completed.begin();
+         it != connection.completed.end() && it->first == connection.next_response;
+         it = connection.completed.erase(it), ++connection.next_response) {
+        Response& ready = it->second;
+        if (ready.stats) {
+            ready.line = FormatStats();
+        }
+        connection.output += ready.line;
+        connection.output += '\n';
+        ++stats_.requests;
+        if (ready.failed) {
+            ++stats_.errors;
+        }
+        if (ready.searched) {
+            request_queue_.AddRequest(ready.raw_query, ready.documents);
+        }
+    }
+}
+
+void QueryServer::WriteConnection(Connection& connection) {
+    size_t written = 0;
+    while (!connection.failed && written < connection.output.size()) {
+        const ssize_t sent = send(connection.socket.Get(), connection.output.data() + written,
+                                  connection.output.size() - written, MSG_NOSIGNAL);
+        if (sent >= 0) {
+            written += static_cast<size_t>(sent);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else if (errno != EINTR) {
+            connection.failed = true;
+        }
+    }
+    connection.output.erase(0, written);
+    stats_.bytes_written += written;
+}
+
+void QueryServer::UpdateConnection(uint64_t connection_id) {
+    Connection& connection = connections_.at(connection_id);
+    if (!connection.output.empty()) {
+        WriteConnection(connection);
+    }
+    const bool finished = connection.closing && connection.in_flight == 0 && connection.output.empty();
+    if (connection.failed || finished) {
+        // Закрытый дескриптор сам пропадает из epoll
+        connections_.erase(connection_id);
+        return;
+    }
+    uint32_t events = 0;
+    if (!connection.closing && connection.in_flight < options_.max_pipeline_depth) {
+        events |= EPOLLIN;
+    }
+    if (!connection.output.empty()) {
+        events |= EPOLLOUT;
+    }
+    if (events != connection.events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = connection_id;
+        if (epoll_ctl(epoll_.Get(), EPOLL_CTL_MOD, connection.socket.Get(), &event) != 0) {
+            ThrowSystemError("cannot update epoll subscription"s);
+        }
+        connection.events = events;
+    }
+}
+
+string QueryServer::FormatStats() const {
+    const ThreadPoolStats pool_stats = pool_.GetStats();
+    ostringstream line;
+    line << "STATS connections="s << stats_.connections
+         << " requests="s << stats_.requests
+         << " batches="s << stats_.batches
+         << " errors="s << stats_.errors
+         << " no_result="s << request_queue_.GetNoResultRequests()
+         << " bytes_read="s << stats_.bytes_read
+         << " bytes_written="s << stats_.bytes_written
+         << " threads="s << pool_.GetThreadCount()
+         << " stolen_tasks="s << pool_stats.stolen;
+    return line.str();
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+#include "request_queue.h"
+#include "search_server.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+struct QueryServerOptions {
+    // Непустой путь — слушать Unix-сокет, иначе TCP на 127.0.0.1
+    string unix_socket_path;
+    // 0 — выбрать свободный порт, узнать его можно через GetPort
+    uint16_t tcp_port = 0;
+    size_t threads = max(1u, thread::hardware_concurrency());
+    // Сколько готовых запросов уходит в пул одной задачей
+    size_t max_batch_size = 64;
+    // Сколько запросов соединения может ждать ответа; дальше сокет не читается
+    size_t max_pipeline_depth = 1024;
+    size_t max_line_length = 64 * 1024;
+};
+
+struct QueryServerStats {
+    uint64_t connections = 0;
+    uint64_t requests = 0;
+    uint64_t batches = 0;
+    uint64_t errors = 0;
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+};
+
+// Сетевой интерфейс к SearchServer для локальных клиентов. Протокол
+// строковый, запросы можно слать, не дожидаясь ответов (pipelining), ответы
+// приходят в порядке запросов:
+//   FIND <запрос>  ->  OK <n> <id>:<relevance>:<rating> ...
+//   STATS          ->  STATS requests=... no_result=... ...
+// Ошибка разбора отвечается строкой ERROR <сообщение>.
+// Весь ввод-вывод и RequestQueue живут в потоке Run (epoll), поиск идёт в
+// пуле: запросы, готовые за один проход цикла, собираются в пакеты и
+// выполняются через FindTopDocumentsBatch.
+class QueryServer {
+public:
+    // Открывает слушающий сокет; server не должен меняться, пока сервер работает
+    QueryServer(const SearchServer& server, const QueryServerOptions& options = QueryServerOptions());
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+    ~QueryServer();
+
+    // Обслуживает соединения до вызова Stop
+    void Run();
+    // Можно вызывать из любого потока и из обработчика сигнала
+    void Stop();
+
+    uint16_t GetPort() const {
+        return port_;
+    }
+
+    // Вызывать из потока Run или после его завершения
+    const QueryServerStats& GetStats() const {
+        return stats_;
+    }
+
+private:
+    // Закрывает дескриптор в деструкторе
+    class FileDescriptor {
+    public:
+        explicit FileDescriptor(int descriptor = -1)
+            : descriptor_(descriptor) {
+        }
+        FileDescriptor(const FileDescriptor&) = delete;
+        FileDescriptor& operator=(const FileDescriptor&) = delete;
+        ~FileDescriptor();
+
+        // Закрывает прежний дескриптор и владеет новым
+        void Reset(int descriptor);
+
+        int Get() const {
+            return descriptor_;
+        }
+
+    private:
+        int descriptor_;
+    };
+
+    // Метки событий epoll; соединения нумеруются после них
+    static constexpr uint64_t LISTENER_ID = 0;
+    static constexpr uint64_t WAKEUP_ID = 1;
+    static constexpr uint64_t FIRST_CONNECTION_ID = 2;
+
+    struct Request {
+        uint64_t connection_id;
+        uint64_t sequence;
+        string raw_query;
+    };
+
+    struct Response {
+        uint64_t connection_id = 0;
+        uint64_t sequence = 0;
+        string line;
+        // Поисковый запрос, который надо учесть в RequestQueue
+        bool searched = false;
+        bool failed = false;
+        // Ответ на STATS: строка собирается при отправке, когда учтены все предыдущие запросы
+        bool stats = false;
+        string raw_query;
+        vector<Document> documents;
+    };
+
+    struct Connection {
+        FileDescriptor socket;
+        string input;
+        string output;
+        uint64_t next_sequence = 0;
+        uint64_t next_response = 0;
+        // Ответы, обогнавшие более ранние запросы того же соединения
+        map<uint64_t, Response> completed;
+        size_t in_flight = 0;
+        // Клиент закрыл свою сторону или нарушил протокол: закрыть после ответов
+        bool closing = false;
+        // Ошибка сокета: закрыть сразу
+        bool failed = false;
+        uint32_t events = 0;
+    };
+
+    const SearchServer& server_;
+    QueryServerOptions options_;
+    RequestQueue request_queue_;
+    QueryServerStats stats_;
+    uint16_t port_ = 0;
+    atomic<bool> stopping_{false};
+    FileDescriptor listener_;
+    FileDescriptor epoll_;
+    // Будит цикл: готовые ответы пула и Stop
+    FileDescriptor wakeup_;
+    unordered_map<uint64_t, Connection> connections_;
+    uint64_t next_connection_id_ = FIRST_CONNECTION_ID;
+    vector<Request> ready_requests_;
+    mutex responses_mutex_;
+    vector<Response> responses_;
+    // Объявлен последним: разрушается первым и успевает выполнить задачи,
+    // пока дескрипторы ещё открыты
+    ThreadPool pool_;
+
+    void AcceptConnections();
+    void ReadConnection(uint64_t connection_id, Connection& connection);
+    void ParseRequests(uint64_t connection_id, Connection& connection);
+    void DispatchRequests();
+    void ExecuteBatch(const vector<Request>& batch);
+    void CollectResponses();
+    void Deliver(Connection& connection, Response response);
+    void WriteConnection(Connection& connection);
+    // Обновляет подписку epoll и закрывает соединение, которому больше нечего делать
+    void UpdateConnection(uint64_t connection_id);
+    string FormatStats() const;
+    void Wake();
+};
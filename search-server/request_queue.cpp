@@ -1,4 +1,5 @@
 #include "request_queue.h"
+#include "memory_usage.h"
 
 RequestQueue::RequestQueue(const SearchServer& search_server) : server_(search_server) {}
 
@@ -16,6 +17,7 @@ vector<Document> RequestQueue::AddFindRequest(const string& raw_query) {
 
 void RequestQueue::AddRequest(const string& raw_query, const vector<Document>& response) {
     requests_.push_back({raw_query, response});
+    request_bytes_ += GetRequestBytes(requests_.back());
     if (response.empty()) {
         ++EmptyRequestCnt_;
     }
@@ -34,7 +36,21 @@ void RequestQueue::UpdateDeque() {
         if (del_req.response.empty()) {
             --EmptyRequestCnt_;
         }
+        request_bytes_ -= GetRequestBytes(requests_.front());
         requests_.pop_front();
         UpdateDeque();
     }
-}
\ No newline at end of file
+}
+
+size_t RequestQueue::GetMemoryUsage() const {
+    // libstdc++ хранит элементы deque блоками по 512 байт и держит массив указателей на блоки
+    constexpr size_t BLOCK_SIZE = 512;
+    constexpr size_t REQUESTS_PER_BLOCK = sizeof(QueryResult) < BLOCK_SIZE ? BLOCK_SIZE / sizeof(QueryResult) : 1;
+    const size_t blocks = requests_.size() / REQUESTS_PER_BLOCK + 1;
+    return request_bytes_ + blocks * memory_usage::HeapBlock(REQUESTS_PER_BLOCK * sizeof(QueryResult))
+        + memory_usage::HeapBlock((blocks + 2) * sizeof(void*));
+}
+
+size_t RequestQueue::GetRequestBytes(const QueryResult& request) {
+    return memory_usage::StringHeap(request.raw_query) + memory_usage::VectorHeap(request.response);
+}
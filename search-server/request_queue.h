@@ -24,6 +24,8 @@ public:
     void AddRequest(const string& raw_query, const vector<Document>& response);
     int GetNoResultRequests() const;
     void UpdateDeque();
+    // Оценка памяти истории запросов в байтах, ведётся при добавлении и вытеснении
+    size_t GetMemoryUsage() const;
 
 private:
     struct QueryResult {
@@ -34,4 +36,8 @@ private:
     const static int min_in_day_ = 1440;
     const SearchServer& server_;
     int EmptyRequestCnt_ = 0;
+    // Строки запросов и выдачи в куче; блоки самой deque считаются по её размеру
+    size_t request_bytes_ = 0;
+
+    static size_t GetRequestBytes(const QueryResult& request);
 }; 
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// Курсор по выдаче запроса. Помнит только последний выданный документ
+// и получает следующую страницу через FindTopDocumentsAfter, поэтому
+// листание вглубь не требует сортировки всей выдачи.
+template <typename DocumentPredicate>
+class SearchCursor {
+public:
+    SearchCursor(const SearchServer& server, SearchServer::PreparedQuery query, size_t page_size,
+                 DocumentPredicate document_predicate)
+        : server_(server), query_(std::move(query)), page_size_(page_size),
+          document_predicate_(std::move(document_predicate)) {
+        if (page_size_ == 0) {
+            throw invalid_argument("page size must be greater then 0"s);
+        }
+    }
+
+    // Пустая страница означает, что выдача закончилась
+    vector<Document> NextPage() {
+        if (exhausted_) {
+            return {};
+        }
+        if (server_.IsStale(query_)) {
+            server_.RefreshQuery(query_);
+        }
+        auto page = last_document_
+            ? server_.FindTopDocumentsAfter(query_, *last_document_, page_size_, document_predicate_)
+            : server_.FindTopDocumentsPage(query_, nullptr, page_size_, document_predicate_);
+        if (page.size() < page_size_) {
+            exhausted_ = true;
+        }
+        if (!page.empty()) {
+            last_document_ = page.back();
+        }
+        return page;
+    }
+
+    bool IsExhausted() const {
+        return exhausted_;
+    }
+
+private:
+    const SearchServer& server_;
+    SearchServer::PreparedQuery query_;
+    size_t page_size_;
+    DocumentPredicate document_predicate_;
+    optional<Document> last_document_;
+    bool exhausted_ = false;
+};
+
+template <typename DocumentPredicate>
+auto MakeSearchCursor(const SearchServer& server, std::string_view raw_query, size_t page_size,
+                      DocumentPredicate document_predicate) {
+    return SearchCursor<DocumentPredicate>(server, server.PrepareQuery(raw_query), page_size, document_predicate);
+}
+
+inline auto MakeSearchCursor(const SearchServer& server, std::string_view raw_query, size_t page_size,
+                             DocumentStatus status = DocumentStatus::ACTUAL) {
+    return MakeSearchCursor(server, raw_query, page_size, [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    });
+}
@@ -3,9 +3,68 @@
 #include "string_processing.h"
 #include "search_server.h"
 #include "log_duration.h"
+#include "binary_io.h"
+#include "memory_usage.h"
 
+namespace {
 
-SearchServer::SearchServer(const string& stop_words_text) : SearchServer(SplitIntoWords(stop_words_text)) {}
+size_t MemtableWordBytes(const string& word) {
+    return memory_usage::TreeNode<IndexSegment::MutablePostings::value_type>() + memory_usage::StringHeap(word);
+}
+
+size_t MemtablePostingBytes() {
+    return memory_usage::TreeNode<map<int, double>::value_type>();
+}
+
+}  // namespace
+
+SearchServer::SearchServer(const string& stop_words_text, const IndexOptions& options)
+    : SearchServer(SplitIntoWords(stop_words_text), options) {}
+
+SearchServer::SearchServer(SearchServer&& other)
+    : stop_words_(other.stop_words_), options_(other.options_) {
+    // Фоновое слияние other ссылается на other, поэтому сначала оно завершается
+    other.StopMergeThread();
+    word_to_document_freqs_ = move(other.word_to_document_freqs_);
+    memtable_documents_ = move(other.memtable_documents_);
+    // Ключи словаря не переезжают при перемещении map, term_words_ остаются верны
+    term_dictionary_ = move(other.term_dictionary_);
+    term_words_ = move(other.term_words_);
+    free_term_ids_ = move(other.free_term_ids_);
+    document_to_word_freqs_ = move(other.document_to_word_freqs_);
+    document_to_term_ids_ = move(other.document_to_term_ids_);
+    documents_ = move(other.documents_);
+    document_ids_ = move(other.document_ids_);
+    index_version_ = other.index_version_;
+    term_dictionary_bytes_ = exchange(other.term_dictionary_bytes_, 0);
+    memtable_postings_bytes_ = exchange(other.memtable_postings_bytes_, 0);
+    memtable_posting_count_ = exchange(other.memtable_posting_count_, 0);
+    forward_index_bytes_ = exchange(other.forward_index_bytes_, 0);
+    // Подготовленные запросы к other устаревают
+    ++other.index_version_;
+
+    lock_guard lock(segments_mutex_);
+    segments_ = move(other.segments_);
+    other.segments_.clear();
+    if (options_.background_merge && !PickMergeCandidates().empty()) {
+        StartMergeThread();
+    }
+}
+
+SearchServer::~SearchServer() {
+    StopMergeThread();
+}
+
+void SearchServer::StopMergeThread() {
+    {
+        lock_guard lock(segments_mutex_);
+        stop_merging_ = true;
+    }
+    merge_condition_.notify_all();
+    if (merge_thread_.joinable()) {
+        merge_thread_.join();
+    }
+}
 
 
 void SearchServer::AddDocument(int document_id, const string& document, DocumentStatus status,
@@ -19,16 +78,194 @@ void SearchServer::AddDocument(int document_id, const string& document, Document
 
     const auto words = SplitIntoWordsNoStop(document);
     const double inv_word_count = 1.0 / words.size();
+    map<string, double> word_freqs;
+    for (const string_view word : words) {
+        word_freqs[string(word)] += inv_word_count;
+    }
+    InsertDocument(document_id, move(word_freqs), ComputeAverageRating(ratings), status);
+}
+
+void SearchServer::InsertDocument(int document_id, map<string, double> word_freqs, int rating,
+                                  DocumentStatus status) {
+    vector<uint32_t> term_ids;
+    if (options_.forward_index == ForwardIndexMode::COMPACT) {
+        term_ids.reserve(word_freqs.size());
+    }
+    for (const auto& [word, term_freq] : word_freqs) {
+        auto postings = word_to_document_freqs_.find(word);
+        if (postings == word_to_document_freqs_.end()) {
+            postings = word_to_document_freqs_.emplace(word, map<int, double>{}).first;
+            memtable_postings_bytes_ += MemtableWordBytes(word);
+        }
+        postings->second.emplace(document_id, term_freq);
+        memtable_postings_bytes_ += MemtablePostingBytes();
+        ++memtable_posting_count_;
+        auto term = term_dictionary_.find(word);
+        if (term == term_dictionary_.end()) {
+            term = AddTerm(word);
+        }
+        ++term->second.document_freq;
+        if (options_.forward_index == ForwardIndexMode::COMPACT) {
+            term_ids.push_back(term->second.term_id);
+        }
+    }
+    if (options_.forward_index == ForwardIndexMode::FULL) {
+        document_to_word_freqs_.emplace(document_id, move(word_freqs));
+    } else if (options_.forward_index == ForwardIndexMode::COMPACT) {
+        sort(term_ids.begin(), term_ids.end());
+        document_to_term_ids_.emplace(document_id, move(term_ids));
+    }
+    forward_index_bytes_ += GetForwardEntryBytes(document_id);
+    documents_.emplace(document_id, DocumentData{rating, status});
+    document_ids_.insert(document_id);
+    memtable_documents_.insert(document_id);
+    ++index_version_;
+
+    if (options_.memtable_document_limit > 0 && memtable_documents_.size() >= options_.memtable_document_limit) {
+        FreezeMemtable();
+    }
+}
+
+void SearchServer::RemoveDocument(int document_id) {
+    if (documents_.count(document_id) == 0) {
+        return;
+    }
+    // Слова копируются: в режиме COMPACT они указывают в словарь, из которого удаляются
+    vector<string> words;
+    ForEachDocumentWord(document_id, GetSegmentsSnapshot(), [&words](string_view word, double) {
+        words.emplace_back(word);
+    });
     for (const string& word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][word] += inv_word_count;
+        const auto term = term_dictionary_.find(word);
+        if (--term->second.document_freq == 0) {
+            ReleaseTerm(term);
+        }
+    }
+    if (memtable_documents_.erase(document_id) > 0) {
+        for (const string& word : words) {
+            const auto postings = word_to_document_freqs_.find(word);
+            postings->second.erase(document_id);
+            memtable_postings_bytes_ -= MemtablePostingBytes();
+            --memtable_posting_count_;
+            if (postings->second.empty()) {
+                memtable_postings_bytes_ -= MemtableWordBytes(postings->first);
+                word_to_document_freqs_.erase(postings);
+            }
+        }
+    } else {
+        RemoveFromSegments(document_id);
+    }
+    forward_index_bytes_ -= GetForwardEntryBytes(document_id);
+    document_to_word_freqs_.erase(document_id);
+    document_to_term_ids_.erase(document_id);
+    documents_.erase(document_id);
+    document_ids_.erase(document_id);
+    ++index_version_;
+}
+
+// Формат: число документов, затем для каждого id, статус, рейтинг и частоты слов.
+// Частоты пишутся в том виде, в каком их хранит индекс: точно из изменяемого
+// сегмента и прямого индекса FULL, а в режимах COMPACT и NONE для документов
+// из сегментов — с точностью options_.term_freq_precision. Повторное округление
+// их не меняет, поэтому индекс с той же точностью после восстановления ранжирует так же.
+void SearchServer::SaveSnapshot(string& output) const {
+    const auto segments = GetSegmentsSnapshot();
+    vector<pair<string_view, double>> word_freqs;
+    binary_io::AppendInteger(output, static_cast<uint64_t>(document_ids_.size()));
+    for (const int document_id : document_ids_) {
+        const DocumentData& document_data = documents_.at(document_id);
+        word_freqs.clear();
+        ForEachDocumentWord(document_id, segments, [&word_freqs](string_view word, double term_freq) {
+            word_freqs.emplace_back(word, term_freq);
+        });
+        binary_io::AppendInteger(output, static_cast<int32_t>(document_id));
+        binary_io::AppendInteger(output, static_cast<uint8_t>(document_data.status));
+        binary_io::AppendInteger(output, static_cast<int32_t>(document_data.rating));
+        binary_io::AppendInteger(output, static_cast<uint32_t>(word_freqs.size()));
+        for (const auto& [word, term_freq] : word_freqs) {
+            binary_io::AppendString(output, word);
+            binary_io::AppendDouble(output, term_freq);
+        }
+    }
+}
+
+void SearchServer::LoadSnapshot(string_view snapshot) {
+    if (!documents_.empty()) {
+        throw invalid_argument("snapshot can be loaded only into an empty search server"s);
+    }
+    binary_io::Reader reader(snapshot);
+    const auto document_count = reader.ReadInteger<uint64_t>();
+    for (uint64_t i = 0; i < document_count; ++i) {
+        const int document_id = reader.ReadInteger<int32_t>();
+        const auto status = static_cast<DocumentStatus>(reader.ReadInteger<uint8_t>());
+        const int rating = reader.ReadInteger<int32_t>();
+        if (document_id < 0 || documents_.count(document_id) > 0) {
+            throw invalid_argument("snapshot contains invalid document id"s);
+        }
+        map<string, double> word_freqs;
+        const auto word_count = reader.ReadInteger<uint32_t>();
+        for (uint32_t j = 0; j < word_count; ++j) {
+            const string_view word = reader.ReadString();
+            word_freqs.emplace(string(word), reader.ReadDouble());
+        }
+        InsertDocument(document_id, move(word_freqs), rating, status);
+    }
+    if (!reader.AtEnd()) {
+        throw invalid_argument("snapshot has trailing data"s);
+    }
+}
+
+void SearchServer::Flush() {
+    if (!memtable_documents_.empty()) {
+        FreezeMemtable();
+    }
+}
+
+void SearchServer::WaitForMerges() const {
+    unique_lock lock(segments_mutex_);
+    merge_condition_.wait(lock, [this] {
+        return !merge_in_progress_ && (stop_merging_ || PickMergeCandidates().empty());
+    });
+}
+
+size_t SearchServer::GetSegmentCount() const {
+    lock_guard lock(segments_mutex_);
+    return segments_.size();
+}
+
+SearchServer::PreparedQuery SearchServer::PrepareQuery(string_view raw_query) const {
+    const auto query = ParseQuery(raw_query);
+    PreparedQuery prepared_query;
+    prepared_query.plus_words_.assign(query.plus_words.begin(), query.plus_words.end());
+    prepared_query.minus_words_.assign(query.minus_words.begin(), query.minus_words.end());
+    RefreshQuery(prepared_query);
+    return prepared_query;
+}
+
+bool SearchServer::IsStale(const PreparedQuery& query) const {
+    return query.server_ != this || query.index_version_ != index_version_;
+}
+
+void SearchServer::RefreshQuery(PreparedQuery& query) const {
+    query.server_ = this;
+    query.index_version_ = index_version_;
+    query.segments_ = GetSegmentsSnapshot();
+    query.plus_terms_.clear();
+    query.minus_terms_.clear();
+    for (size_t i = 0; i < query.plus_words_.size(); ++i) {
+        if (term_dictionary_.count(query.plus_words_[i]) > 0) {
+            query.plus_terms_.push_back(ResolveTerm(i, query.plus_words_[i], query.segments_));
+        }
+    }
+    for (size_t i = 0; i < query.minus_words_.size(); ++i) {
+        if (term_dictionary_.count(query.minus_words_[i]) > 0) {
+            query.minus_terms_.push_back(ResolveTerm(i, query.minus_words_[i], query.segments_));
+        }
     }
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
-    document_ids_.push_back(document_id);
 }
 
 vector<Document> SearchServer::FindTopDocuments(const string& raw_query, DocumentStatus status) const {
-    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+    return FindTopDocuments(raw_query, [status](int, DocumentStatus document_status, int) {
         return document_status == status;
     });
 }
@@ -37,6 +274,112 @@ vector<Document> SearchServer::FindTopDocuments(const string& raw_query) const {
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentStatus status) const {
+    return FindTopDocuments(query, [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    });
+}
+
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query) const {
+    return FindTopDocuments(query, DocumentStatus::ACTUAL);
+}
+
+BudgetedSearchResult SearchServer::FindTopDocumentsWithBudget(const PreparedQuery& query, const SearchBudget& budget,
+                                                              DocumentStatus status) const {
+    return FindTopDocumentsWithBudget(query, budget, [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    });
+}
+
+BudgetedSearchResult SearchServer::FindTopDocumentsWithBudget(const string& raw_query, const SearchBudget& budget,
+                                                              DocumentStatus status) const {
+    return FindTopDocumentsWithBudget(PrepareQuery(raw_query), budget, status);
+}
+
+vector<const SearchServer::PreparedQuery::Term*> SearchServer::GetTermsRarestFirst(const PreparedQuery& query) {
+    vector<const PreparedQuery::Term*> terms;
+    terms.reserve(query.plus_terms_.size());
+    for (const auto& term : query.plus_terms_) {
+        terms.push_back(&term);
+    }
+    // Чем больше IDF, тем реже слово
+    stable_sort(terms.begin(), terms.end(), [](const PreparedQuery::Term* lhs, const PreparedQuery::Term* rhs) {
+        return lhs->inverse_document_freq > rhs->inverse_document_freq;
+    });
+    return terms;
+}
+
+bool SearchServer::TakePosting(const SearchBudget& budget, size_t& postings_scanned) {
+    if (budget.max_postings > 0 && postings_scanned >= budget.max_postings) {
+        return false;
+    }
+    if (budget.deadline != chrono::steady_clock::time_point::max() && postings_scanned % DEADLINE_CHECK_INTERVAL == 0
+        && chrono::steady_clock::now() >= budget.deadline) {
+        return false;
+    }
+    ++postings_scanned;
+    return true;
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const vector<PreparedQuery>& queries,
+                                                             DocumentStatus status) const {
+    return FindTopDocumentsBatch(queries, [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    });
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const vector<string>& raw_queries,
+                                                             DocumentStatus status) const {
+    vector<PreparedQuery> queries;
+    queries.reserve(raw_queries.size());
+    for (const string& raw_query : raw_queries) {
+        queries.push_back(PrepareQuery(raw_query));
+    }
+    return FindTopDocumentsBatch(queries, status);
+}
+
+void SearchServer::SelectPage(vector<Document>& documents, const Document* after, size_t page_size) {
+    if (after != nullptr) {
+        const auto not_after = remove_if(documents.begin(), documents.end(), [after](const Document& document) {
+            return !IsRankedBefore(*after, document);
+        });
+        documents.erase(not_after, documents.end());
+    }
+    const size_t result_size = min(page_size, documents.size());
+    partial_sort(documents.begin(), documents.begin() + result_size, documents.end(), IsRankedBefore);
+    documents.resize(result_size);
+}
+
+vector<Document> SearchServer::SumContributions(vector<ScoreContribution>& contributions,
+                                                vector<int>& excluded_documents) const {
+    // Устойчивая сортировка сохраняет порядок слов, поэтому сумма совпадает с FindAllDocuments
+    stable_sort(contributions.begin(), contributions.end(), [](const ScoreContribution& lhs, const ScoreContribution& rhs) {
+        return lhs.document_id < rhs.document_id;
+    });
+    sort(excluded_documents.begin(), excluded_documents.end());
+    vector<Document> documents;
+    for (auto it = contributions.begin(); it != contributions.end();) {
+        const int document_id = it->document_id;
+        double relevance = 0.0;
+        for (; it != contributions.end() && it->document_id == document_id; ++it) {
+            relevance += it->relevance;
+        }
+        if (!binary_search(excluded_documents.begin(), excluded_documents.end(), document_id)) {
+            documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+        }
+    }
+    return documents;
+}
+
+vector<Document> SearchServer::MakeDocuments(const map<int, double>& document_to_relevance) const {
+    vector<Document> documents;
+    documents.reserve(document_to_relevance.size());
+    for (const auto [document_id, relevance] : document_to_relevance) {
+        documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+    }
+    return documents;
+}
+
 int SearchServer::GetDocumentCount() const {
     return documents_.size();
 }
@@ -46,60 +389,114 @@ int SearchServer::GetDocumentCount() const {
 // }
 
 const map<string, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    if (document_to_word_freqs_.count(document_id)) {
-        return document_to_word_freqs_.at(document_id);
+    if (options_.forward_index != ForwardIndexMode::FULL) {
+        throw invalid_argument("word frequencies are stored only with ForwardIndexMode::FULL"s);
     }
-    const map<string, double>& empty_map = {};
-    return empty_map;
+    static const map<string, double> empty_word_freqs;
+    const auto word_freqs = document_to_word_freqs_.find(document_id);
+    return word_freqs != document_to_word_freqs_.end() ? word_freqs->second : empty_word_freqs;
 }
 
-vector<int>::iterator SearchServer::begin() {
+map<string, double> SearchServer::CollectWordFrequencies(int document_id) const {
+    if (options_.forward_index == ForwardIndexMode::FULL) {
+        return GetWordFrequencies(document_id);
+    }
+    map<string, double> word_freqs;
+    if (documents_.count(document_id) > 0) {
+        ForEachDocumentWord(document_id, GetSegmentsSnapshot(), [&word_freqs](string_view word, double term_freq) {
+            word_freqs.emplace(string(word), term_freq);
+        });
+    }
+    return word_freqs;
+}
+
+IndexMemoryStats SearchServer::GetMemoryStats() const {
+    using namespace memory_usage;
+    IndexMemoryStats stats;
+    stats.term_dictionary_bytes = term_dictionary_bytes_ + VectorHeap(term_words_) + VectorHeap(free_term_ids_);
+    stats.postings_bytes = memtable_postings_bytes_;
+    stats.forward_index_bytes = forward_index_bytes_;
+    stats.document_table_bytes = MapNodes(documents_) + SetNodes(document_ids_) + SetNodes(memtable_documents_);
+    stats.stop_words_bytes = stop_words_.GetMemoryUsage();
+    stats.terms = term_dictionary_.size();
+    stats.postings = memtable_posting_count_;
+    stats.documents = documents_.size();
+    {
+        lock_guard lock(segments_mutex_);
+        stats.segments = segments_.size();
+        for (const SegmentEntry& entry : segments_) {
+            // Сегмент и множество tombstones созданы make_shared вместе со счётчиком ссылок
+            stats.term_dictionary_bytes += entry.segment->GetDictionaryMemoryUsage();
+            stats.postings_bytes += HeapBlock(sizeof(IndexSegment) + 16) + entry.segment->GetPostingsMemoryUsage();
+            stats.postings += entry.segment->GetPostingCount();
+            if (entry.tombstones) {
+                stats.tombstone_bytes += HeapBlock(sizeof(set<int>) + 16) + SetNodes(*entry.tombstones);
+            }
+        }
+    }
+    if (stats.terms > 0) {
+        stats.average_posting_length = static_cast<double>(stats.postings) / stats.terms;
+    }
+    return stats;
+}
+
+size_t SearchServer::GetForwardEntryBytes(int document_id) const {
+    using namespace memory_usage;
+    if (options_.forward_index == ForwardIndexMode::FULL) {
+        const auto& word_freqs = document_to_word_freqs_.at(document_id);
+        size_t bytes = TreeNode<decltype(document_to_word_freqs_)::value_type>() + MapNodes(word_freqs);
+        for (const auto& [word, _] : word_freqs) {
+            bytes += StringHeap(word);
+        }
+        return bytes;
+    }
+    if (options_.forward_index == ForwardIndexMode::COMPACT) {
+        return TreeNode<decltype(document_to_term_ids_)::value_type>()
+            + VectorHeap(document_to_term_ids_.at(document_id));
+    }
+    return 0;
+}
+
+set<int>::const_iterator SearchServer::begin() const {
     return document_ids_.begin();
 }
 
-vector<int>::iterator SearchServer::end() {
+set<int>::const_iterator SearchServer::end() const {
     return document_ids_.end();
 }
 
 tuple<vector<string>, DocumentStatus> SearchServer::MatchDocument(const string& raw_query, int document_id) const {
     LOG_DURATION_STREAM("Матчинг документов по запросу: "s + raw_query);
-    auto query = ParseQuery(raw_query);
+    const auto query = PrepareQuery(raw_query);
+    const DocumentStatus status = documents_.at(document_id).status;
     vector<string> matched_words;
-    for (const string& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
+    for (const auto& term : query.minus_terms_) {
+        if (TermContainsDocument(term, document_id)) {
+            return make_tuple(matched_words, status);
         }
     }
-    for (const string& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.clear();
-            break;
+    for (const auto& term : query.plus_terms_) {
+        if (TermContainsDocument(term, document_id)) {
+            matched_words.push_back(query.plus_words_[term.word_index]);
         }
     }
-    return make_tuple(matched_words, documents_.at(document_id).status);
+    return make_tuple(matched_words, status);
 }
 
-bool SearchServer::IsStopWord(const string& word) const {
-    return stop_words_.count(word) > 0;
+bool SearchServer::IsStopWord(string_view word) const {
+    return stop_words_.Contains(word);
 }
 
-vector<string> SearchServer::SplitIntoWordsNoStop(const string& text) const {
-    vector<string> words;
-    for (const string& word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw invalid_argument("Invalid word '"s + word + "'"s);
-        }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
+vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
+    auto tokens = TokenizeText(text);
+    if (tokens.first_invalid_word != NO_INVALID_WORD) {
+        throw invalid_argument("Invalid word '"s + string(tokens.words[tokens.first_invalid_word]) + "'"s);
     }
-    return words;
+    const auto stop_words_begin = remove_if(tokens.words.begin(), tokens.words.end(), [this](string_view word) {
+        return IsStopWord(word);
+    });
+    tokens.words.erase(stop_words_begin, tokens.words.end());
+    return tokens.words;
 }
 
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
@@ -109,22 +506,27 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     return accumulate(ratings.begin(), ratings.end(), 0) / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(string text) const {
+// Отсутствие спецсимволов уже проверено в ParseQuery
+SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
     bool is_minus = false;
     if (text[0] == '-') {
         is_minus = true;
-        text = text.substr(1);
+        text.remove_prefix(1);
     }
-    if (text.empty() || text[0] == '-' || !IsValidWord(text)) {
+    if (text.empty() || text[0] == '-') {
         throw invalid_argument("Invalid query"s);
     }
 
     return QueryWord{text, is_minus, IsStopWord(text)};
 }
 
-SearchServer::Query SearchServer::ParseQuery(const string& text) const {
+SearchServer::Query SearchServer::ParseQuery(string_view text) const {
+    const auto tokens = TokenizeText(text);
+    if (tokens.first_invalid_word != NO_INVALID_WORD) {
+        throw invalid_argument("Invalid query"s);
+    }
     Query result;
-    for (const string& word : SplitIntoWords(text)) {
+    for (const string_view word : tokens.words) {
         const auto query_word = ParseQueryWord(word);
 
         if (!query_word.is_stop) {
@@ -138,6 +540,266 @@ SearchServer::Query SearchServer::ParseQuery(const string& text) const {
     return result;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const string& word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+double SearchServer::ComputeWordInverseDocumentFreq(size_t documents_with_word) const {
+    return log(GetDocumentCount() * 1.0 / documents_with_word);
+}
+
+void SearchServer::CheckQueryOwner(const PreparedQuery& query) const {
+    if (query.server_ != this) {
+        throw invalid_argument("prepared query belongs to another search server"s);
+    }
+}
+
+vector<SegmentEntry> SearchServer::GetSegmentsSnapshot() const {
+    lock_guard lock(segments_mutex_);
+    return segments_;
+}
+
+SearchServer::PreparedQuery::Term SearchServer::ResolveTerm(size_t word_index, string_view word,
+                                                            const vector<SegmentEntry>& segments) const {
+    PreparedQuery::Term term{word_index, 0.0, nullptr, {}};
+    const auto term_data = term_dictionary_.find(word);
+    if (term_data != term_dictionary_.end()) {
+        term.inverse_document_freq = ComputeWordInverseDocumentFreq(term_data->second.document_freq);
+    }
+    const auto memtable_postings = word_to_document_freqs_.find(word);
+    if (memtable_postings != word_to_document_freqs_.end()) {
+        term.memtable_postings = &memtable_postings->second;
+    }
+    for (const SegmentEntry& entry : segments) {
+        const PostingSpan postings = entry.segment->FindPostings(word);
+        if (!postings.empty()) {
+            const set<int>* tombstones = entry.tombstones && !entry.tombstones->empty() ? entry.tombstones.get() : nullptr;
+            term.segment_postings.push_back({postings, tombstones});
+        }
+    }
+    return term;
+}
+
+bool SearchServer::TermContainsDocument(const PreparedQuery::Term& term, int document_id) {
+    if (term.memtable_postings != nullptr && term.memtable_postings->count(document_id) > 0) {
+        return true;
+    }
+    for (const auto& [postings, tombstones] : term.segment_postings) {
+        if ((tombstones == nullptr || tombstones->count(document_id) == 0) && postings.ContainsDocument(document_id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SearchServer::TermDictionary::iterator SearchServer::AddTerm(string_view word) {
+    uint32_t term_id = static_cast<uint32_t>(term_words_.size());
+    if (!free_term_ids_.empty()) {
+        term_id = free_term_ids_.back();
+        free_term_ids_.pop_back();
+    } else {
+        term_words_.emplace_back();
+    }
+    const auto term = term_dictionary_.emplace(string(word), TermData{0, term_id}).first;
+    term_words_[term_id] = term->first;
+    term_dictionary_bytes_ += memory_usage::TreeNode<TermDictionary::value_type>() + memory_usage::StringHeap(term->first);
+    return term;
+}
+
+void SearchServer::ReleaseTerm(TermDictionary::iterator term) {
+    term_words_[term->second.term_id] = {};
+    free_term_ids_.push_back(term->second.term_id);
+    term_dictionary_bytes_ -= memory_usage::TreeNode<TermDictionary::value_type>() + memory_usage::StringHeap(term->first);
+    term_dictionary_.erase(term);
+}
+
+const SegmentEntry* SearchServer::FindLiveSegment(const vector<SegmentEntry>& segments, int document_id) {
+    for (const SegmentEntry& entry : segments) {
+        if (entry.segment->ContainsDocument(document_id) && !entry.IsDeleted(document_id)) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void SearchServer::ForEachDocumentWord(int document_id, const vector<SegmentEntry>& segments,
+                                       const function<void(string_view, double)>& function) const {
+    const bool in_memtable = memtable_documents_.count(document_id) > 0;
+    const SegmentEntry* segment_entry = nullptr;
+    if (!in_memtable && options_.forward_index != ForwardIndexMode::FULL) {
+        segment_entry = FindLiveSegment(segments, document_id);
+    }
+    const auto term_freq = [&](string_view word) {
+        if (in_memtable) {
+            return word_to_document_freqs_.find(word)->second.at(document_id);
+        }
+        const PostingSpan postings = segment_entry->segment->FindPostings(word);
+        return postings.GetTermFreq(postings.FindDocument(document_id));
+    };
+
+    switch (options_.forward_index) {
+    case ForwardIndexMode::FULL:
+        for (const auto& [word, freq] : document_to_word_freqs_.at(document_id)) {
+            function(word, freq);
+        }
+        break;
+    case ForwardIndexMode::COMPACT:
+        for (const uint32_t term_id : document_to_term_ids_.at(document_id)) {
+            const string_view word = term_words_[term_id];
+            function(word, term_freq(word));
+        }
+        break;
+    case ForwardIndexMode::NONE:
+        if (in_memtable) {
+            for (const auto& [word, postings] : word_to_document_freqs_) {
+                const auto posting = postings.find(document_id);
+                if (posting != postings.end()) {
+                    function(word, posting->second);
+                }
+            }
+        } else {
+            const IndexSegment& segment = *segment_entry->segment;
+            for (size_t i = 0; i < segment.GetTermCount(); ++i) {
+                const PostingSpan postings = segment.GetPostings(i);
+                const size_t position = postings.FindDocument(document_id);
+                if (position != postings.size()) {
+                    function(segment.GetTerm(i), postings.GetTermFreq(position));
+                }
+            }
+        }
+        break;
+    }
+}
+
+void SearchServer::FreezeMemtable() {
+    auto segment = make_shared<const IndexSegment>(word_to_document_freqs_, memtable_documents_,
+                                                   options_.term_freq_precision);
+    word_to_document_freqs_.clear();
+    memtable_documents_.clear();
+    memtable_postings_bytes_ = 0;
+    memtable_posting_count_ = 0;
+    // Подготовленные запросы ссылаются на вхождения изменяемого сегмента
+    ++index_version_;
+
+    unique_lock lock(segments_mutex_);
+    segments_.push_back({move(segment), nullptr});
+    ScheduleMerges(lock);
+}
+
+// Кандидаты появляются и при заморозке, и при удалении: tombstones уменьшают
+// число живых документов сегмента и могут перевести его на уровень ниже
+void SearchServer::ScheduleMerges(unique_lock<mutex>& lock) {
+    if (PickMergeCandidates().empty()) {
+        return;
+    }
+    if (!options_.background_merge) {
+        RunMerges(lock);
+        return;
+    }
+    StartMergeThread();
+    merge_condition_.notify_all();
+}
+
+void SearchServer::StartMergeThread() {
+    if (!merge_thread_.joinable()) {
+        merge_thread_ = thread([this] {
+            MergeLoop();
+        });
+    }
+}
+
+void SearchServer::RemoveFromSegments(int document_id) {
+    unique_lock lock(segments_mutex_);
+    for (SegmentEntry& entry : segments_) {
+        if (entry.segment->ContainsDocument(document_id) && !entry.IsDeleted(document_id)) {
+            // Снимки берутся только под мьютексом: если множество больше никто не держит,
+            // его можно дополнить на месте, иначе читатели получат копию при записи
+            if (entry.tombstones && entry.tombstones.use_count() == 1) {
+                const_pointer_cast<set<int>>(entry.tombstones)->insert(document_id);
+            } else {
+                auto tombstones = entry.tombstones ? make_shared<set<int>>(*entry.tombstones) : make_shared<set<int>>();
+                tombstones->insert(document_id);
+                entry.tombstones = move(tombstones);
+            }
+            ScheduleMerges(lock);
+            return;
+        }
+    }
+}
+
+// Многоуровневая (tiered) политика: сегмент уровня k содержит порядка
+// memtable_document_limit * merge_factor^k документов. Сливаются самые старые
+// merge_factor сегментов первого уровня, где их набралось столько.
+vector<SegmentEntry> SearchServer::PickMergeCandidates() const {
+    const size_t merge_factor = max<size_t>(2, options_.merge_factor);
+    const size_t base_size = max<size_t>(1, options_.memtable_document_limit);
+    map<size_t, vector<SegmentEntry>> tiers;
+    for (const SegmentEntry& entry : segments_) {
+        size_t tier = 0;
+        for (size_t tier_size = base_size * merge_factor; entry.GetLiveDocumentCount() >= tier_size;
+             tier_size *= merge_factor) {
+            ++tier;
+        }
+        auto& tier_segments = tiers[tier];
+        tier_segments.push_back(entry);
+        if (tier_segments.size() == merge_factor) {
+            return tier_segments;
+        }
+    }
+    return {};
+}
+
+shared_ptr<const IndexSegment> SearchServer::MergeSegments(const vector<SegmentEntry>& candidates) const {
+    vector<const IndexSegment*> segments;
+    vector<const set<int>*> tombstones;
+    for (const SegmentEntry& entry : candidates) {
+        segments.push_back(entry.segment.get());
+        tombstones.push_back(entry.tombstones.get());
+    }
+    return make_shared<const IndexSegment>(segments, tombstones, options_.term_freq_precision);
+}
+
+void SearchServer::InstallMergedSegment(const vector<SegmentEntry>& candidates,
+                                        shared_ptr<const IndexSegment> merged) {
+    // Документы, удалённые во время слияния, остались в новом сегменте — переносим их tombstones
+    auto tombstones = make_shared<set<int>>();
+    auto insert_position = segments_.end();
+    for (const SegmentEntry& candidate : candidates) {
+        const auto current = find_if(segments_.begin(), segments_.end(), [&candidate](const SegmentEntry& entry) {
+            return entry.segment == candidate.segment;
+        });
+        if (current->tombstones && current->tombstones != candidate.tombstones) {
+            for (const int document_id : *current->tombstones) {
+                if (!candidate.IsDeleted(document_id)) {
+                    tombstones->insert(document_id);
+                }
+            }
+        }
+        insert_position = segments_.erase(current);
+    }
+    if (merged->GetDocumentCount() > 0) {
+        segments_.insert(insert_position, {move(merged), tombstones->empty() ? nullptr : move(tombstones)});
+    }
+}
+
+// Сегменты сливаются без блокировки, под мьютексом только выбор и установка результата
+void SearchServer::RunMerges(unique_lock<mutex>& lock) {
+    for (auto candidates = PickMergeCandidates(); !candidates.empty(); candidates = PickMergeCandidates()) {
+        merge_in_progress_ = true;
+        lock.unlock();
+        auto merged = MergeSegments(candidates);
+        lock.lock();
+        InstallMergedSegment(candidates, move(merged));
+        merge_in_progress_ = false;
+        merge_condition_.notify_all();
+    }
+}
+
+void SearchServer::MergeLoop() {
+    unique_lock lock(segments_mutex_);
+    while (true) {
+        merge_condition_.wait(lock, [this] {
+            return stop_merging_ || !PickMergeCandidates().empty();
+        });
+        if (stop_merging_) {
+            return;
+        }
+        RunMerges(lock);
+    }
 }
\ No newline at end of file
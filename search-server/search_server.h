@@ -1,17 +1,27 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <set>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 #include <numeric>
 
 #include "document.h"
+#include "index_segment.h"
 #include "paginator.h"
 #include "string_processing.h"
+#include "stop_words.h"
 #include "log_duration.h"
 
 using namespace std;
@@ -19,44 +29,349 @@ using namespace std;
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 const double FLOAT_COMPARE_THRESHOLD = 1e-6;
 
+// Релевантность, огрублённая до FLOAT_COMPARE_THRESHOLD. Условие «разница меньше
+// порога» нетранзитивно: a ~ b и b ~ c не дают a ~ c, и сортировка по нему не
+// задаёт порядка, так что курсор мог пропускать документы или зацикливаться.
+// Номер корзины сравнивается точно.
+inline double RelevanceBucket(double relevance) {
+    return round(relevance / FLOAT_COMPARE_THRESHOLD);
+}
+
+// Порядок выдачи: по убыванию релевантности, при равной (в одной корзине
+// RelevanceBucket) — по убыванию рейтинга, затем по возрастанию id.
+// Это строгий полный порядок, поэтому тройка (relevance, rating, id)
+// однозначно задаёт место документа в выдаче.
+inline bool IsRankedBefore(const Document& lhs, const Document& rhs) {
+    const double lhs_bucket = RelevanceBucket(lhs.relevance);
+    const double rhs_bucket = RelevanceBucket(rhs.relevance);
+    if (lhs_bucket != rhs_bucket) {
+        return lhs_bucket > rhs_bucket;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+}
+
+// Ограничение работы одного запроса; по умолчанию ограничений нет
+struct SearchBudget {
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max();
+    // Сколько вхождений можно просмотреть; 0 — сколько угодно
+    size_t max_postings = 0;
+};
+
+struct BudgetedSearchResult {
+    vector<Document> documents;
+    // Бюджет кончился раньше, чем были просмотрены все вхождения плюс-слов
+    bool partial = false;
+    size_t postings_scanned = 0;
+};
+
+// Как хранится прямой индекс (слова каждого документа), нужный
+// CollectWordFrequencies и RemoveDocument
+enum class ForwardIndexMode {
+    // Слова документа с частотами
+    FULL,
+    // Отсортированные идентификаторы слов; частоты берутся из обратного индекса
+    COMPACT,
+    // Прямого индекса нет: CollectWordFrequencies, RemoveDocument и SaveSnapshot
+    // просматривают весь изменяемый сегмент или сегмент документа
+    NONE,
+};
+
+// Индекс состоит из изменяемого сегмента, принимающего AddDocument, и неизменяемых
+// сегментов. Заполненный изменяемый сегмент замораживается, а сегменты одного
+// уровня (размера) сливаются по merge_factor штук.
+struct IndexOptions {
+    // Сколько документов принимает изменяемый сегмент до заморозки; 0 — не замораживать
+    size_t memtable_document_limit = 4096;
+    size_t merge_factor = 4;
+    // Сливать сегменты в фоновом потоке, иначе — сразу после заморозки
+    bool background_merge = true;
+    ForwardIndexMode forward_index = ForwardIndexMode::FULL;
+    // Точность частот в замороженных сегментах; изменяемый сегмент и прямой
+    // индекс FULL всегда хранят double
+    TermFreqPrecision term_freq_precision = TermFreqPrecision::DOUBLE;
+};
+
+// Оценка памяти индекса в байтах (см. memory_usage.h) и его размеры
+struct IndexMemoryStats {
+    // Словарь слов с документной частотой и словари неизменяемых сегментов
+    size_t term_dictionary_bytes = 0;
+    size_t postings_bytes = 0;
+    size_t forward_index_bytes = 0;
+    size_t document_table_bytes = 0;
+    size_t stop_words_bytes = 0;
+    // Множества документов, удалённых из неизменяемых сегментов
+    size_t tombstone_bytes = 0;
+
+    size_t terms = 0;
+    // Вхождения удалённых документов считаются, пока сегменты не слиты
+    size_t postings = 0;
+    size_t documents = 0;
+    size_t segments = 0;
+    double average_posting_length = 0.0;
+
+    size_t GetTotalBytes() const {
+        return term_dictionary_bytes + postings_bytes + forward_index_bytes + document_table_bytes
+            + stop_words_bytes + tombstone_bytes;
+    }
+};
+
 class SearchServer {
 public:
 
     inline static constexpr int INVALID_DOCUMENT_ID = -1;
 
+    // Принимает любой контейнер строк или StaticStopWords, собранный во время компиляции
     template <typename StringContainer>
-    SearchServer(const StringContainer& stop_words)
-        : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
+    SearchServer(const StringContainer& stop_words, const IndexOptions& options = IndexOptions())
+        : stop_words_(MakeStopWords(stop_words)), options_(options) {
     }
 
-    SearchServer(const string& stop_words_text);
+    SearchServer(const string& stop_words_text, const IndexOptions& options = IndexOptions());
+
+    // Копирование запрещено: сервер владеет потоком слияния и мьютексом.
+    // Перемещение дожидается слияния в other и забирает его индекс; other
+    // остаётся пустым, а его подготовленные запросы к новому серверу не подходят
+    SearchServer(const SearchServer&) = delete;
+    SearchServer& operator=(const SearchServer&) = delete;
+    SearchServer(SearchServer&& other);
+    ~SearchServer();
 
     void AddDocument(int document_id, const string& document, DocumentStatus status,
                                    const vector<int>& ratings);
 
+    // Документ из неизменяемого сегмента помечается удалённым (tombstone)
+    // и физически удаляется при слиянии сегментов
+    void RemoveDocument(int document_id);
+
+    // Дописывает в output двоичный снимок всех документов
+    void SaveSnapshot(string& output) const;
+    // Восстанавливает документы из снимка; сервер должен быть пуст
+    void LoadSnapshot(string_view snapshot);
+
+    // Замораживает изменяемый сегмент, даже если он заполнен не до конца
+    void Flush();
+    // Дожидается, пока фоновый поток сольёт все сегменты, которые пора сливать
+    void WaitForMerges() const;
+    size_t GetSegmentCount() const;
+
+    // Запрос, разобранный и проверенный один раз. Слова запроса уже найдены
+    // в индексе, IDF посчитан. Плюс-слова, которых нет в индексе, отброшены.
+    // После AddDocument, RemoveDocument и заморозки сегмента запрос устаревает
+    // (IsStale): FindTopDocuments обновит его копию сам, а RefreshQuery обновит
+    // сам запрос без повторного разбора. Слияние сегментов запрос не портит:
+    // он держит снимок сегментов, на которых был подготовлен.
+    class PreparedQuery {
+    public:
+        PreparedQuery() = default;
+
+    private:
+        friend class SearchServer;
+
+        struct SegmentPostings {
+            PostingSpan postings;
+            // nullptr, если из сегмента ничего не удалено
+            const set<int>* tombstones;
+        };
+
+        struct Term {
+            size_t word_index;
+            double inverse_document_freq;
+            // nullptr, если слова нет в изменяемом сегменте
+            const map<int, double>* memtable_postings;
+            vector<SegmentPostings> segment_postings;
+        };
+
+        const SearchServer* server_ = nullptr;
+        uint64_t index_version_ = 0;
+        vector<string> plus_words_;
+        vector<string> minus_words_;
+        vector<SegmentEntry> segments_;
+        vector<Term> plus_terms_;
+        vector<Term> minus_terms_;
+    };
+
+    PreparedQuery PrepareQuery(string_view raw_query) const;
+    bool IsStale(const PreparedQuery& query) const;
+    void RefreshQuery(PreparedQuery& query) const;
+
     template <typename DocumentPredicate>
     vector<Document> FindTopDocuments(const string& raw_query, DocumentPredicate document_predicate) const {
         LOG_DURATION_STREAM("Результаты поиска по запросу: "s + raw_query);
-        const auto query = ParseQuery(raw_query);
+        return FindTopDocuments(PrepareQuery(raw_query), document_predicate);
+    }
+
+    template <typename DocumentPredicate>
+    vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentPredicate document_predicate) const {
+        return FindTopDocumentsPage(query, nullptr, MAX_RESULT_DOCUMENT_COUNT, document_predicate);
+    }
+
+    // Постраничная выдача в стиле search_after: page_size документов, идущих
+    // в выдаче (IsRankedBefore) сразу за документом after с предыдущей страницы.
+    // Сортируется только сама страница, поэтому глубина страницы не важна.
+    template <typename DocumentPredicate>
+    vector<Document> FindTopDocumentsAfter(const PreparedQuery& query, const Document& after, size_t page_size,
+                                           DocumentPredicate document_predicate) const {
+        return FindTopDocumentsPage(query, &after, page_size, document_predicate);
+    }
+
+    template <typename DocumentPredicate>
+    vector<Document> FindTopDocumentsPage(const PreparedQuery& query, const Document* after, size_t page_size,
+                                          DocumentPredicate document_predicate) const {
+        CheckQueryOwner(query);
+        if (IsStale(query)) {
+            PreparedQuery fresh_query = query;
+            RefreshQuery(fresh_query);
+            return FindTopDocumentsPage(fresh_query, after, page_size, document_predicate);
+        }
         auto matched_documents = FindAllDocuments(query, document_predicate);
+        SelectPage(matched_documents, after, page_size);
+        return matched_documents;
+    }
 
-        sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-            if (abs(lhs.relevance - rhs.relevance) < FLOAT_COMPARE_THRESHOLD) {
-                return lhs.rating > rhs.rating;
+    // Выдача с ограниченной работой. Плюс-слова обходятся от редких к частым:
+    // редкое слово весит больше и даёт меньше вхождений, поэтому при нехватке
+    // бюджета теряются в основном слабые вклады частых слов. Когда бюджет
+    // кончается, подсчёт останавливается и возвращаются лучшие из уже найденных
+    // документов с флагом partial. Минус-слова применяются всегда: документ
+    // проверяется по их спискам вхождений, а не наоборот.
+    template <typename DocumentPredicate>
+    BudgetedSearchResult FindTopDocumentsWithBudget(const PreparedQuery& query, const SearchBudget& budget,
+                                                    DocumentPredicate document_predicate) const {
+        CheckQueryOwner(query);
+        if (IsStale(query)) {
+            PreparedQuery fresh_query = query;
+            RefreshQuery(fresh_query);
+            return FindTopDocumentsWithBudget(fresh_query, budget, document_predicate);
+        }
+
+        BudgetedSearchResult result;
+        map<int, double> document_to_relevance;
+        for (const PreparedQuery::Term* term : GetTermsRarestFirst(query)) {
+            const bool completed = ForEachScoredPostingWhile(*term, [&](int document_id, double score) {
+                if (!TakePosting(budget, result.postings_scanned)) {
+                    return false;
+                }
+                const auto& document_data = documents_.at(document_id);
+                if (document_predicate(document_id, document_data.status, document_data.rating)) {
+                    document_to_relevance[document_id] += score;
+                }
+                return true;
+            });
+            if (!completed) {
+                result.partial = true;
+                break;
+            }
+        }
+
+        for (auto it = document_to_relevance.begin(); it != document_to_relevance.end();) {
+            const bool excluded = any_of(query.minus_terms_.begin(), query.minus_terms_.end(),
+                [document_id = it->first](const PreparedQuery::Term& term) {
+                    return TermContainsDocument(term, document_id);
+                });
+            it = excluded ? document_to_relevance.erase(it) : next(it);
+        }
+        result.documents = MakeDocuments(document_to_relevance);
+        SelectPage(result.documents, nullptr, MAX_RESULT_DOCUMENT_COUNT);
+        return result;
+    }
+
+    BudgetedSearchResult FindTopDocumentsWithBudget(const PreparedQuery& query, const SearchBudget& budget,
+                                                    DocumentStatus status = DocumentStatus::ACTUAL) const;
+    BudgetedSearchResult FindTopDocumentsWithBudget(const string& raw_query, const SearchBudget& budget,
+                                                    DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    // Пакетное выполнение: запросы группируются по словам, и список вхождений
+    // каждого слова проходится один раз для всех запросов пакета, содержащих
+    // это слово. Предикат вызывается один раз на вхождение, а не на запрос.
+    // Результат i-го запроса совпадает с FindTopDocuments(queries[i], predicate).
+    template <typename DocumentPredicate>
+    vector<vector<Document>> FindTopDocumentsBatch(const vector<PreparedQuery>& queries,
+                                                   DocumentPredicate document_predicate) const {
+        vector<PreparedQuery> fresh_queries;
+        vector<const PreparedQuery*> batch;
+        batch.reserve(queries.size());
+        fresh_queries.reserve(queries.size());
+        for (const PreparedQuery& query : queries) {
+            CheckQueryOwner(query);
+            if (IsStale(query)) {
+                fresh_queries.push_back(query);
+                RefreshQuery(fresh_queries.back());
+                batch.push_back(&fresh_queries.back());
             } else {
-                return lhs.relevance > rhs.relevance;
+                batch.push_back(&query);
             }
-        });
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
         }
 
-        return matched_documents;
+        // Слова в порядке возрастания, как и в каждом запросе, поэтому
+        // релевантность складывается в том же порядке, что и в FindTopDocuments
+        map<string_view, SharedTerm> plus_terms;
+        map<string_view, SharedTerm> minus_terms;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            for (const auto& term : batch[i]->plus_terms_) {
+                auto& shared_term = plus_terms[batch[i]->plus_words_[term.word_index]];
+                shared_term.term = &term;
+                shared_term.query_indexes.push_back(i);
+            }
+            for (const auto& term : batch[i]->minus_terms_) {
+                auto& shared_term = minus_terms[batch[i]->minus_words_[term.word_index]];
+                shared_term.term = &term;
+                shared_term.query_indexes.push_back(i);
+            }
+        }
+
+        // Вклады вхождений только дописываются в буфер запроса, а складываются
+        // в конце: сотни деревьев, растущих одновременно, не помещаются в кеш
+        vector<vector<ScoreContribution>> contributions(batch.size());
+        for (const auto& [_, shared_term] : plus_terms) {
+            ForEachScoredPosting(*shared_term.term, [&](int document_id, double relevance) {
+                const auto& document_data = documents_.at(document_id);
+                if (!document_predicate(document_id, document_data.status, document_data.rating)) {
+                    return;
+                }
+                for (const size_t query_index : shared_term.query_indexes) {
+                    contributions[query_index].push_back({document_id, relevance});
+                }
+            });
+        }
+        vector<vector<int>> excluded_documents(batch.size());
+        for (const auto& [_, shared_term] : minus_terms) {
+            ForEachPosting(*shared_term.term, [&](int document_id, double) {
+                for (const size_t query_index : shared_term.query_indexes) {
+                    excluded_documents[query_index].push_back(document_id);
+                }
+            });
+        }
+
+        vector<vector<Document>> results(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            results[i] = SumContributions(contributions[i], excluded_documents[i]);
+            SelectPage(results[i], nullptr, MAX_RESULT_DOCUMENT_COUNT);
+        }
+        return results;
     }
 
+    vector<vector<Document>> FindTopDocumentsBatch(const vector<PreparedQuery>& queries,
+                                                   DocumentStatus status = DocumentStatus::ACTUAL) const;
+    // Ошибка разбора любого запроса отменяет весь пакет
+    vector<vector<Document>> FindTopDocumentsBatch(const vector<string>& raw_queries,
+                                                   DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentStatus status) const;
+    vector<Document> FindTopDocuments(const PreparedQuery& query) const;
+
+    // Без копирования, только в режиме ForwardIndexMode::FULL
     const map<string, double>& GetWordFrequencies(int document_id) const;
-    vector<int>::iterator begin();
-    vector<int>::iterator end();
+    // Копия частот в любом режиме; в COMPACT и NONE собирается из обратного индекса
+    map<string, double> CollectWordFrequencies(int document_id) const;
+    // Счётчики ведутся при изменении индекса, поэтому вызов стоит O(число сегментов)
+    // и подходит для регулярного сбора метрик
+    IndexMemoryStats GetMemoryStats() const;
+    // Идентификаторы документов по возрастанию
+    set<int>::const_iterator begin() const;
+    set<int>::const_iterator end() const;
     vector<Document> FindTopDocuments(const string& raw_query, DocumentStatus status) const;
     vector<Document> FindTopDocuments(const string& raw_query) const;
     int GetDocumentCount() const;
@@ -70,65 +385,221 @@ private:
         int rating;
         DocumentStatus status;
     };
-    const set<string> stop_words_;
-    map<string, map<int, double>> word_to_document_freqs_;
+    const StopWords stop_words_;
+    const IndexOptions options_;
+    // Изменяемый сегмент
+    map<string, map<int, double>, less<>> word_to_document_freqs_;
+    set<int> memtable_documents_;
+    struct TermData {
+        // В скольких живых документах всех сегментов встречается слово — для IDF
+        int document_freq = 0;
+        uint32_t term_id = 0;
+    };
+    using TermDictionary = map<string, TermData, less<>>;
+    TermDictionary term_dictionary_;
+    // Слово по идентификатору; идентификаторы удалённых слов переиспользуются
+    vector<string_view> term_words_;
+    vector<uint32_t> free_term_ids_;
+    // Прямой индекс: заполнен один из двух в зависимости от options_.forward_index
     map<int, map<string, double>> document_to_word_freqs_;
+    map<int, vector<uint32_t>> document_to_term_ids_;
     map<int, DocumentData> documents_;
-    vector<int> document_ids_;
+    set<int> document_ids_;
+    // Меняется при каждом изменении индекса, по нему устаревают PreparedQuery
+    uint64_t index_version_ = 0;
 
-    bool IsStopWord(const string& word) const;
+    // Память узлов деревьев и длинных строк, которую нельзя получить
+    // из размеров контейнеров
+    size_t term_dictionary_bytes_ = 0;
+    size_t memtable_postings_bytes_ = 0;
+    size_t memtable_posting_count_ = 0;
+    size_t forward_index_bytes_ = 0;
 
-    vector<string> SplitIntoWordsNoStop(const string& text) const;
+    // Неизменяемые сегменты от старых к новым. Список меняют и AddDocument
+    // с RemoveDocument, и фоновый поток слияния, поэтому он под мьютексом.
+    mutable mutex segments_mutex_;
+    mutable condition_variable merge_condition_;
+    vector<SegmentEntry> segments_;
+    bool merge_in_progress_ = false;
+    bool stop_merging_ = false;
+    thread merge_thread_;
+
+    template <typename StringContainer>
+    static StopWords MakeStopWords(const StringContainer& stop_words) {
+        return StopWords(MakeUniqueNonEmptyStrings(stop_words));
+    }
+
+    template <size_t N>
+    static StopWords MakeStopWords(const StaticStopWords<N>& stop_words) {
+        return StopWords(stop_words);
+    }
+
+    bool IsStopWord(string_view word) const;
+
+    vector<string_view> SplitIntoWordsNoStop(string_view text) const;
 
     int ComputeAverageRating(const vector<int>& ratings);
 
+    void InsertDocument(int document_id, map<string, double> word_freqs, int rating, DocumentStatus status);
+    TermDictionary::iterator AddTerm(string_view word);
+    void ReleaseTerm(TermDictionary::iterator term);
+    size_t GetForwardEntryBytes(int document_id) const;
+
+    // Слова документа с частотами в любом режиме прямого индекса; segments нужен
+    // для документов из неизменяемых сегментов
+    void ForEachDocumentWord(int document_id, const vector<SegmentEntry>& segments,
+                             const function<void(string_view, double)>& function) const;
+    static const SegmentEntry* FindLiveSegment(const vector<SegmentEntry>& segments, int document_id);
+
+    // Слова запроса указывают в строку запроса
     struct QueryWord {
-        string data;
+        string_view data;
         bool is_minus;
         bool is_stop;
     };
 
-    QueryWord ParseQueryWord(string text) const;
+    QueryWord ParseQueryWord(string_view text) const;
 
     struct Query {
-        set<string> plus_words;
-        set<string> minus_words;
+        set<string_view> plus_words;
+        set<string_view> minus_words;
     };
 
-    Query ParseQuery(const string& text) const;
+    Query ParseQuery(string_view text) const;
 
-    // Existence required
-    double ComputeWordInverseDocumentFreq(const string& word) const;
+    double ComputeWordInverseDocumentFreq(size_t documents_with_word) const;
 
-    template <typename DocumentPredicate>
-    vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
-        map<int, double> document_to_relevance;
-        for (const string& word : query.plus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                continue;
+    void CheckQueryOwner(const PreparedQuery& query) const;
+
+    vector<SegmentEntry> GetSegmentsSnapshot() const;
+    PreparedQuery::Term ResolveTerm(size_t word_index, string_view word, const vector<SegmentEntry>& segments) const;
+    static bool TermContainsDocument(const PreparedQuery::Term& term, int document_id);
+
+    void FreezeMemtable();
+    // Вызывается под segments_mutex_; поток запускается при первой надобности
+    void StartMergeThread();
+    void StopMergeThread();
+    void RemoveFromSegments(int document_id);
+    // Вызываются с захваченным segments_mutex_
+    void ScheduleMerges(unique_lock<mutex>& lock);
+    vector<SegmentEntry> PickMergeCandidates() const;
+    void InstallMergedSegment(const vector<SegmentEntry>& candidates, shared_ptr<const IndexSegment> merged);
+    shared_ptr<const IndexSegment> MergeSegments(const vector<SegmentEntry>& candidates) const;
+    void RunMerges(unique_lock<mutex>& lock);
+    void MergeLoop();
+
+    // Слово пакета запросов и запросы, в которых оно встречается
+    struct SharedTerm {
+        const PreparedQuery::Term* term = nullptr;
+        vector<size_t> query_indexes;
+    };
+
+    struct ScoreContribution {
+        int document_id;
+        double relevance;
+    };
+
+    // Складывает вклады каждого документа в порядке их добавления
+    vector<Document> SumContributions(vector<ScoreContribution>& contributions, vector<int>& excluded_documents) const;
+
+    // Оставляет page_size документов, идущих в выдаче сразу за after (или с начала)
+    static void SelectPage(vector<Document>& documents, const Document* after, size_t page_size);
+    vector<Document> MakeDocuments(const map<int, double>& document_to_relevance) const;
+
+    // Как часто FindTopDocumentsWithBudget сверяется с часами
+    static constexpr size_t DEADLINE_CHECK_INTERVAL = 16;
+
+    static vector<const PreparedQuery::Term*> GetTermsRarestFirst(const PreparedQuery& query);
+    // Списывает одно вхождение; false, если бюджет исчерпан
+    static bool TakePosting(const SearchBudget& budget, size_t& postings_scanned);
+
+    // Сколько вкладов вхождений считается за один вызов векторного ядра
+    static constexpr size_t SCORE_BLOCK_SIZE = 128;
+
+    // Передаёт function номер документа и вклад вхождения в релевантность
+    // (частота, умноженная на IDF) и останавливается, когда function вернёт false.
+    // Частоты изменяемого сегмента округляются так же, как при заморозке, чтобы
+    // одинаковые документы были равны по релевантности, где бы они ни лежали.
+    // Возвращает true, если просмотрены все вхождения.
+    template <typename Function>
+    bool ForEachScoredPostingWhile(const PreparedQuery::Term& term, Function function) const {
+        if (term.memtable_postings != nullptr) {
+            const TermFreqPrecision precision = options_.term_freq_precision;
+            // При точных частотах округлять нечего, и цикл обходится без вызова на вхождение
+            if (precision == TermFreqPrecision::DOUBLE) {
+                for (const auto [document_id, term_freq] : *term.memtable_postings) {
+                    if (!function(document_id, term_freq * term.inverse_document_freq)) {
+                        return false;
+                    }
+                }
+            } else {
+                for (const auto [document_id, term_freq] : *term.memtable_postings) {
+                    if (!function(document_id, RoundTermFreq(term_freq, precision) * term.inverse_document_freq)) {
+                        return false;
+                    }
+                }
             }
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id] += term_freq * inverse_document_freq;
+        }
+        double scores[SCORE_BLOCK_SIZE];
+        for (const auto& [postings, tombstones] : term.segment_postings) {
+            for (size_t first = 0; first < postings.size(); first += SCORE_BLOCK_SIZE) {
+                const size_t count = min(SCORE_BLOCK_SIZE, postings.size() - first);
+                postings.ComputeScores(first, count, term.inverse_document_freq, scores);
+                for (size_t i = 0; i < count; ++i) {
+                    const int document_id = postings.GetDocumentId(first + i);
+                    if ((tombstones == nullptr || tombstones->count(document_id) == 0)
+                        && !function(document_id, scores[i])) {
+                        return false;
+                    }
                 }
             }
         }
+        return true;
+    }
+
+    template <typename Function>
+    void ForEachScoredPosting(const PreparedQuery::Term& term, Function function) const {
+        ForEachScoredPostingWhile(term, [&function](int document_id, double score) {
+            function(document_id, score);
+            return true;
+        });
+    }
 
-        for (const string& word : query.minus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                continue;
+    // Обходит вхождения слова во всех сегментах, пропуская удалённые документы
+    template <typename Function>
+    static void ForEachPosting(const PreparedQuery::Term& term, Function function) {
+        if (term.memtable_postings != nullptr) {
+            for (const auto [document_id, term_freq] : *term.memtable_postings) {
+                function(document_id, term_freq);
             }
-            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.erase(document_id);
+        }
+        for (const auto& [postings, tombstones] : term.segment_postings) {
+            for (const Posting& posting : postings) {
+                if (tombstones == nullptr || tombstones->count(posting.document_id) == 0) {
+                    function(posting.document_id, posting.term_freq);
+                }
             }
         }
+    }
+
+    template <typename DocumentPredicate>
+    vector<Document> FindAllDocuments(const PreparedQuery& query, DocumentPredicate document_predicate) const {
+        map<int, double> document_to_relevance;
+        for (const auto& term : query.plus_terms_) {
+            ForEachScoredPosting(term, [&](int document_id, double score) {
+                const auto& document_data = documents_.at(document_id);
+                if (document_predicate(document_id, document_data.status, document_data.rating)) {
+                    document_to_relevance[document_id] += score;
+                }
+            });
+        }
 
-        vector<Document> matched_documents;
-        for (const auto [document_id, relevance] : document_to_relevance) {
-            matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+        for (const auto& term : query.minus_terms_) {
+            ForEachPosting(term, [&](int document_id, double) {
+                document_to_relevance.erase(document_id);
+            });
         }
-        return matched_documents;
+
+        return MakeDocuments(document_to_relevance);
     }
 };
\ No newline at end of file
@@ -0,0 +1,5 @@
+#include "search_server_test.h"
+
+int main() {
+    TestSearchServer();
+}
@@ -1,7 +1,23 @@
 #pragma once
 
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <memory>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
 #include "search_server.h"
+#include "search_cursor.h"
+#include "durable_search_server.h"
 #include "request_queue.h"
+#include "query_server.h"
+#include "thread_pool.h"
 
 using namespace std;
 
@@ -99,6 +115,40 @@ void AssertImpl(bool value, const string& expr_str, const string& file, const st
 
 #define ASSERT_HINT(expr, hint) AssertImpl(!!(expr), #expr, __FILE__, __FUNCTION__, __LINE__, (hint))
 
+// Общий корпус тестов устройства индекса. Тексты идут по кругу, поэтому
+// одинаковые документы попадают и в изменяемый сегмент, и в разные замороженные
+const string INDEX_TEST_STOP_WORDS = "and in the"s;
+const vector<string> INDEX_TEST_TEXTS = {
+	"white cat and fancy collar"s, "fluffy cat fluffy tail"s, "groomed dog expressive eyes"s,
+	"groomed starling evgeny"s, "white dog fancy tail"s, "cat in the city"s, "dog and cat"s,
+};
+
+const string& GetIndexTestText(int document_id) {
+	return INDEX_TEST_TEXTS[document_id % INDEX_TEST_TEXTS.size()];
+}
+
+// Документы first_id..last_id-1 с текстами корпуса и рейтингом, равным id
+void AddIndexTestDocuments(SearchServer& server, int first_id, int last_id) {
+	for (int id = first_id; id < last_id; ++id) {
+		server.AddDocument(id, GetIndexTestText(id), DocumentStatus::ACTUAL, {id});
+	}
+}
+
+// Вся выдача запроса, без ограничения числа документов и фильтра по статусу
+vector<Document> FindAllIndexTestDocuments(const SearchServer& server, const string& raw_query) {
+	return server.FindTopDocumentsPage(server.PrepareQuery(raw_query), nullptr, 1000,
+		[](int, DocumentStatus, int) { return true; });
+}
+
+// Тот же порядок документов, релевантность отличается меньше чем на tolerance
+void AssertSameRanking(const vector<Document>& actual, const vector<Document>& expected, double tolerance) {
+	ASSERT_EQUAL(actual.size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i) {
+		ASSERT_EQUAL(actual[i].id, expected[i].id);
+		ASSERT(abs(actual[i].relevance - expected[i].relevance) <= tolerance);
+	}
+}
+
 
 
 
@@ -111,7 +161,7 @@ void TestExcludeStopWordsFromAddedDocumentContent() {
     // находит нужный документ
     {
         SearchServer server("and"s);
-        server.AddDocument(doc_id, content, Document::DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(doc_id, content, DocumentStatus::ACTUAL, ratings);
         const auto found_docs = server.FindTopDocuments("in"s);
         ASSERT_EQUAL(found_docs.size(), 1);
         const Document& doc0 = found_docs[0];
@@ -122,7 +172,7 @@ void TestExcludeStopWordsFromAddedDocumentContent() {
     // возвращает пустой результат
     {
         SearchServer server("in the"s);
-        server.AddDocument(doc_id, content, Document::DocumentStatus::ACTUAL, ratings);
+        server.AddDocument(doc_id, content, DocumentStatus::ACTUAL, ratings);
         ASSERT(server.FindTopDocuments("in"s).empty());
     }
 }
@@ -131,7 +181,7 @@ void TestAddDocument() {
 	// Проверим, что добавляемый документ находится по слову из него
 	{
 		SearchServer server("and"s);
-		server.AddDocument(43, "dog in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(43, "dog in the city"s, DocumentStatus::ACTUAL, {1,2,3});
 		const auto found_docs = server.FindTopDocuments("dog"s);
 		ASSERT_EQUAL(found_docs.size(), 1);
 		ASSERT_EQUAL(found_docs[0].id, 43);
@@ -140,8 +190,8 @@ void TestAddDocument() {
 	{
 		SearchServer server("and"s);
 		ASSERT_EQUAL(server.GetDocumentCount(), 0);
-		server.AddDocument(42, "cat in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(43, "dog in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(43, "dog in the city"s, DocumentStatus::ACTUAL, {1,2,3});
 		ASSERT_EQUAL(server.GetDocumentCount(), 2);
 	}
 }
@@ -149,8 +199,8 @@ void TestAddDocument() {
 void TestExcludedDocumentsWithMinusWords() {
 	{
 		SearchServer server("and"s);
-		server.AddDocument(42, "cat in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(43, "dog in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(43, "dog in the city"s, DocumentStatus::ACTUAL, {1,2,3});
 		const auto found_docs = server.FindTopDocuments("city -dog"s);
 		ASSERT_EQUAL(found_docs.size(), 1);
 		ASSERT_EQUAL(found_docs[0].id, 42);
@@ -160,7 +210,7 @@ void TestExcludedDocumentsWithMinusWords() {
 void TestDocumentMatching() {
 	{
 		SearchServer server("and"s);
-		server.AddDocument(42, "cat in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, {1,2,3});
 		const auto [matched_words, status] = server.MatchDocument("in city", 42);
 		//const auto matched_words = get<0>(matching_result);
 		ASSERT_EQUAL(matched_words.size(),2);
@@ -170,7 +220,7 @@ void TestDocumentMatching() {
 	}
 	{
 		SearchServer server("and"s);
-		server.AddDocument(42, "cat in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, {1,2,3});
 		const auto matching_result = server.MatchDocument("in city", 42);
 		const auto matched_words = get<0>(matching_result);
 		ASSERT_EQUAL(matched_words.size(),2);
@@ -179,7 +229,7 @@ void TestDocumentMatching() {
 	}
 	{
 		SearchServer server("and"s);
-		server.AddDocument(42, "cat in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, {1,2,3});
 		const auto matching_result = server.MatchDocument("in city -cat", 42);
 		const auto matched_words = get<0>(matching_result);
 		ASSERT_EQUAL(matched_words.size(), 0);
@@ -187,12 +237,12 @@ void TestDocumentMatching() {
 //	5 out of 6
 	{
 		SearchServer server("and"s);
-		server.AddDocument(42, "cat in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(43, "dog in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(44, "pig in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(45, "lost in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(46, "rain in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(47, "ghost in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(43, "dog in the city"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(44, "pig in the city"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(45, "lost in the city"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(46, "rain in the city"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(47, "ghost in the city"s, DocumentStatus::ACTUAL, {1,2,3});
 		const auto found_docs = server.FindTopDocuments("city"s);
 		ASSERT_EQUAL(found_docs.size(), 5);
 	}
@@ -201,10 +251,10 @@ void TestDocumentMatching() {
 void TestDocsSortByRelevance() {
 	{
 		SearchServer server("and"s);
-		server.AddDocument(42, "dog run"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(45, "dog in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(46, "dog in box"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(44, "dog in the city and pants"s, Document::DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(42, "dog run"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(45, "dog in the city"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(46, "dog in box"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(44, "dog in the city and pants"s, DocumentStatus::ACTUAL, {1,2,3});
 		const auto found_docs = server.FindTopDocuments("dog city pants"s);
 		ASSERT_EQUAL(found_docs.size(), 4);
 		ASSERT_EQUAL(found_docs[0].id, 44);
@@ -216,8 +266,8 @@ void TestDocsSortByRelevance() {
 void TestDocsRating() {
 	{
 		SearchServer server("and"s);
-		server.AddDocument(42, "cat in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(43, "dog in the city"s, Document::DocumentStatus::ACTUAL, {100, 10, 100});
+		server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(43, "dog in the city"s, DocumentStatus::ACTUAL, {100, 10, 100});
 		const auto found_docs = server.FindTopDocuments("city"s);
 		ASSERT_EQUAL(found_docs[0].rating, 70); // (100 + 10 + 100) / 3 = 70
 		ASSERT_EQUAL(found_docs[1].rating, 2); // (1 + 2 + 3) / 3 = 2
@@ -227,10 +277,10 @@ void TestDocsRating() {
 void TestSearchWithPredicate() {
 	{
 		SearchServer server("and"s);
-		server.AddDocument(54, "dog in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(55, "dog in the city"s, Document::DocumentStatus::ACTUAL, {100, 10, 100});
-		server.AddDocument(297, "dog in the small town"s, Document::DocumentStatus::ACTUAL, {100, 10, 100});
-		const auto found_docs = server.FindTopDocuments("dog"s, [](int document_id, Document::DocumentStatus status, int rating) { return document_id % 27 == 0; });
+		server.AddDocument(54, "dog in the city"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(55, "dog in the city"s, DocumentStatus::ACTUAL, {100, 10, 100});
+		server.AddDocument(297, "dog in the small town"s, DocumentStatus::ACTUAL, {100, 10, 100});
+		const auto found_docs = server.FindTopDocuments("dog"s, [](int document_id, DocumentStatus status, int rating) { return document_id % 27 == 0; });
 		ASSERT_EQUAL(found_docs.size(), 2);
 		ASSERT_EQUAL(found_docs[0].id, 297);
 		ASSERT_EQUAL(found_docs[1].id, 54);
@@ -240,18 +290,18 @@ void TestSearchWithPredicate() {
 void TestSearchWithStatus() {
 	{
 		SearchServer server("and"s);
-		server.AddDocument(54, "dog in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(55, "dog in the city"s, Document::DocumentStatus::IRRELEVANT, {100, 10, 100});
-		server.AddDocument(297, "dog in the small town"s, Document::DocumentStatus::BANNED, {100, 10, 100});
-		const auto found_docs = server.FindTopDocuments("dog"s, Document::DocumentStatus::IRRELEVANT);
+		server.AddDocument(54, "dog in the city"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(55, "dog in the city"s, DocumentStatus::IRRELEVANT, {100, 10, 100});
+		server.AddDocument(297, "dog in the small town"s, DocumentStatus::BANNED, {100, 10, 100});
+		const auto found_docs = server.FindTopDocuments("dog"s, DocumentStatus::IRRELEVANT);
 		ASSERT_EQUAL(found_docs.size(), 1);
 		ASSERT_EQUAL(found_docs[0].id, 55);
 	}
 	{
 		SearchServer server("and"s);
-		server.AddDocument(54, "dog in the city"s, Document::DocumentStatus::ACTUAL, {1,2,3});
-		server.AddDocument(55, "dog in the city"s, Document::DocumentStatus::IRRELEVANT, {100, 10, 100});
-		const auto found_docs = server.FindTopDocuments("dog"s, Document::DocumentStatus::REMOVED);
+		server.AddDocument(54, "dog in the city"s, DocumentStatus::ACTUAL, {1,2,3});
+		server.AddDocument(55, "dog in the city"s, DocumentStatus::IRRELEVANT, {100, 10, 100});
+		const auto found_docs = server.FindTopDocuments("dog"s, DocumentStatus::REMOVED);
 		ASSERT_EQUAL(found_docs.size(), 0);
 	}
 }
@@ -259,10 +309,10 @@ void TestSearchWithStatus() {
 void TestCalculateRalavance() {
 	{
 		SearchServer search_server("and"s);
-		search_server.AddDocument(11, "белый кот и модный ошейник"s,        Document::DocumentStatus::ACTUAL, {8, -3});
-		search_server.AddDocument(12, "пушистый кот пушистый хвост"s,       Document::DocumentStatus::ACTUAL, {7, 2, 7});
-		search_server.AddDocument(13, "ухоженный пёс выразительные глаза"s, Document::DocumentStatus::ACTUAL, {5, -12, 2, 1});
-		search_server.AddDocument(14, "ухоженный скворец евгений"s,         Document::DocumentStatus::BANNED, {9});
+		search_server.AddDocument(11, "белый кот и модный ошейник"s,        DocumentStatus::ACTUAL, {8, -3});
+		search_server.AddDocument(12, "пушистый кот пушистый хвост"s,       DocumentStatus::ACTUAL, {7, 2, 7});
+		search_server.AddDocument(13, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, {5, -12, 2, 1});
+		search_server.AddDocument(14, "ухоженный скворец евгений"s,         DocumentStatus::BANNED, {9});
 		const auto found_docs = search_server.FindTopDocuments("пушистый ухоженный кот"s);
 		ASSERT_EQUAL(found_docs.size(), 3);
 		ASSERT(found_docs[0].relevance - 0.866434 < FLOAT_COMPARE_THRESHOLD);
@@ -293,13 +343,13 @@ void TestCalculateRalavance() {
 void TestResultPagination() {
     SearchServer search_server("and with"s);
 
-    search_server.AddDocument(1, "funny pet and nasty rat"s, Document::DocumentStatus::ACTUAL, {7, 2, 7});
-    search_server.AddDocument(2, "funny pet with curly hair"s, Document::DocumentStatus::ACTUAL, {1, 2, 3});
-    search_server.AddDocument(3, "big cat nasty hair"s, Document::DocumentStatus::ACTUAL, {1, 2, 8});
-    search_server.AddDocument(4, "big dog cat Vladislav"s, Document::DocumentStatus::ACTUAL, {1, 3, 2});
-    search_server.AddDocument(5, "big dog hamster Borya"s, Document::DocumentStatus::ACTUAL, {1, 1, 1});
-	search_server.AddDocument(6, "big dog hamster Vasya"s, Document::DocumentStatus::ACTUAL, {1, 1, 1});
-	search_server.AddDocument(7, "big dog hamster Varya"s, Document::DocumentStatus::ACTUAL, {1, 1, 1});
+    search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    search_server.AddDocument(3, "big cat nasty hair"s, DocumentStatus::ACTUAL, {1, 2, 8});
+    search_server.AddDocument(4, "big dog cat Vladislav"s, DocumentStatus::ACTUAL, {1, 3, 2});
+    search_server.AddDocument(5, "big dog hamster Borya"s, DocumentStatus::ACTUAL, {1, 1, 1});
+	search_server.AddDocument(6, "big dog hamster Vasya"s, DocumentStatus::ACTUAL, {1, 1, 1});
+	search_server.AddDocument(7, "big dog hamster Varya"s, DocumentStatus::ACTUAL, {1, 1, 1});
 
     const auto search_results = search_server.FindTopDocuments("curly dog"s);
     int page_size = 2;
@@ -314,11 +364,11 @@ void TestRequestQueueStore() {
 	SearchServer search_server("and in at"s);
     RequestQueue request_queue(search_server);
 
-    search_server.AddDocument(1, "curly cat curly tail"s, Document::DocumentStatus::ACTUAL, {7, 2, 7});
-    search_server.AddDocument(2, "curly dog and fancy collar"s, Document::DocumentStatus::ACTUAL, {1, 2, 3});
-    search_server.AddDocument(3, "big cat fancy collar "s, Document::DocumentStatus::ACTUAL, {1, 2, 8});
-    search_server.AddDocument(4, "big dog sparrow Eugene"s, Document::DocumentStatus::ACTUAL, {1, 3, 2});
-    search_server.AddDocument(5, "big dog sparrow Vasiliy"s, Document::DocumentStatus::ACTUAL, {1, 1, 1});
+    search_server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    search_server.AddDocument(3, "big cat fancy collar "s, DocumentStatus::ACTUAL, {1, 2, 8});
+    search_server.AddDocument(4, "big dog sparrow Eugene"s, DocumentStatus::ACTUAL, {1, 3, 2});
+    search_server.AddDocument(5, "big dog sparrow Vasiliy"s, DocumentStatus::ACTUAL, {1, 1, 1});
 
     // 1439 запросов с нулевым результатом
     for (int i = 0; i < 1439; ++i) {
@@ -334,6 +384,861 @@ void TestRequestQueueStore() {
     ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1437);
 }
 
+void TestTokenizerSimdMatchesScalar() {
+	// Длинные строки проходят через блоки по 16 и 32 байта и через хвост
+	const vector<string> texts = {
+		""s,
+		"   "s,
+		"cat"s,
+		"  curly   cat  "s,
+		"пушистый кот пушистый хвост и модный ошейник белый кот и модный ошейник"s,
+		"big cat fancy collar big cat fancy collar big cat fancy\x01 collar"s,
+		"a b c d e f g h i j k l m n o p q r s t u v w x y z aa bb cc dd ee ff gg"s,
+		"word\twith\ttabs and\nnew lines after thirty two bytes of text here"s,
+		string(31, 'x') + " "s + string(33, 'y') + "\x1f"s,
+	};
+	for (const string& text : texts) {
+		const auto expected = TokenizeText(text, SimdLevel::SCALAR);
+		for (const SimdLevel level : {SimdLevel::SSE2, SimdLevel::AVX2}) {
+			const auto tokens = TokenizeText(text, level);
+			ASSERT_EQUAL_HINT(tokens.words, expected.words, ToString(level));
+			ASSERT_EQUAL_HINT(tokens.first_invalid_word, expected.first_invalid_word, ToString(level));
+		}
+	}
+	const auto tokens = TokenizeText("fancy col\x02lar and cat\x03"s);
+	ASSERT_EQUAL(tokens.words.size(), 4);
+	ASSERT_EQUAL(tokens.first_invalid_word, 1);
+}
+
+void TestInvalidWordsRejected() {
+	SearchServer server("and"s);
+	try {
+		server.AddDocument(1, "curly c\x12t"s, DocumentStatus::ACTUAL, {1});
+		ASSERT_HINT(false, "document with special characters must be rejected"s);
+	} catch (const invalid_argument& e) {
+		ASSERT_EQUAL(string(e.what()), "Invalid word 'c\x12t'"s);
+	}
+	server.AddDocument(1, "curly cat"s, DocumentStatus::ACTUAL, {1});
+	for (const string& query : {"cat d\x12g"s, "--cat"s, "cat -"s}) {
+		try {
+			server.FindTopDocuments(query);
+			ASSERT_HINT(false, "invalid query must be rejected"s);
+		} catch (const invalid_argument& e) {
+			ASSERT_EQUAL(string(e.what()), "Invalid query"s);
+		}
+	}
+}
+
+void TestStopWordsPerfectHash() {
+	// Сотни слов: каждое находится, похожие на них — нет
+	{
+		vector<string> words;
+		for (int i = 0; i < 500; ++i) {
+			words.push_back("stop"s + to_string(i));
+		}
+		const StopWords stop_words(words);
+		ASSERT_EQUAL(stop_words.size(), 500);
+		for (int i = 0; i < 500; ++i) {
+			ASSERT(stop_words.Contains("stop"s + to_string(i)));
+			ASSERT(!stop_words.Contains("stop"s + to_string(i + 500)));
+			ASSERT(!stop_words.Contains("stop"s + to_string(i) + "s"s));
+		}
+		ASSERT(!stop_words.Contains(""s));
+		ASSERT(!StopWords().Contains("stop"s));
+	}
+	// Таблица, построенная компилятором
+	{
+		constexpr auto stop_words = MakeStaticStopWords({"and"sv, "in"sv, "at"sv});
+		static_assert(stop_words.Contains("in"sv));
+		static_assert(!stop_words.Contains("cat"sv));
+
+		SearchServer server(stop_words);
+		server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, {1, 2, 3});
+		ASSERT(server.FindTopDocuments("in"s).empty());
+		ASSERT_EQUAL(server.FindTopDocuments("cat at"s).size(), 1);
+	}
+	// Повторы: таблица времени выполнения их отбрасывает, таблица времени
+	// компиляции отвергает сразу, не перебирая смещения
+	{
+		const StopWords stop_words(vector<string>{"at"s, "in"s, "at"s});
+		ASSERT_EQUAL(stop_words.size(), 2);
+		ASSERT(stop_words.Contains("at"s) && stop_words.Contains("in"s));
+		try {
+			MakeStaticStopWords({"and"sv, "in"sv, "and"sv});
+			ASSERT_HINT(false, "duplicate stop words must be rejected"s);
+		} catch (const invalid_argument& e) {
+			ASSERT_EQUAL(string(e.what()), "duplicate stop word"s);
+		}
+	}
+	// Повторы в контейнере допустимы, как и раньше
+	{
+		SearchServer server(vector<string>{"in"s, "in"s, ""s, "the"s});
+		server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, {1, 2, 3});
+		ASSERT(server.FindTopDocuments("the in"s).empty());
+	}
+}
+
+void TestPreparedQuery() {
+	SearchServer server("and in"s);
+	server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+	server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, {1, 2, 3});
+	server.AddDocument(3, "big cat fancy collar"s, DocumentStatus::BANNED, {1, 2, 8});
+
+	// Один разбор, разные предикаты — те же результаты, что и у строкового запроса
+	const auto query = server.PrepareQuery("curly cat -collar parrot"s);
+	ASSERT(!server.IsStale(query));
+	ASSERT_EQUAL(server.FindTopDocuments(query).size(), 1);
+	ASSERT_EQUAL(server.FindTopDocuments(query)[0].id, 1);
+	ASSERT(server.FindTopDocuments(query, DocumentStatus::BANNED).empty());
+	const auto by_predicate = server.FindTopDocuments(query, [](int document_id, DocumentStatus, int) {
+		return document_id != 1;
+	});
+	ASSERT(by_predicate.empty());
+
+	// Новый документ делает запрос устаревшим; слово parrot, которого не было в индексе, находится
+	server.AddDocument(4, "green parrot"s, DocumentStatus::ACTUAL, {5});
+	ASSERT(server.IsStale(query));
+	const auto fresh_results = server.FindTopDocuments(query);
+	ASSERT_EQUAL(fresh_results.size(), 2);
+	ASSERT_EQUAL(fresh_results[0].id, 4);
+	auto refreshed_query = query;
+	server.RefreshQuery(refreshed_query);
+	ASSERT(!server.IsStale(refreshed_query));
+	ASSERT_EQUAL(server.FindTopDocuments(refreshed_query).size(), 2);
+	ASSERT_EQUAL(server.FindTopDocuments(refreshed_query)[0].relevance, fresh_results[0].relevance);
+
+	// Ошибки разбора обнаруживаются при подготовке, чужой запрос не выполняется
+	try {
+		server.PrepareQuery("cat --dog"s);
+		ASSERT_HINT(false, "invalid query must be rejected"s);
+	} catch (const invalid_argument&) {
+	}
+	SearchServer other_server("and"s);
+	try {
+		other_server.FindTopDocuments(query);
+		ASSERT_HINT(false, "query of another server must be rejected"s);
+	} catch (const invalid_argument&) {
+	}
+}
+
+void TestLazyPaginator() {
+	// Итераторы без произвольного доступа: каждая страница вычисляется при обходе
+	const list<int> values = {1, 2, 3, 4, 5, 6, 7};
+	const auto pages = Paginate(values, 3);
+	ASSERT_EQUAL(pages.size(), 3);
+	vector<size_t> page_sizes;
+	vector<int> visited;
+	for (const auto& page : pages) {
+		page_sizes.push_back(page.size());
+		visited.insert(visited.end(), page.begin(), page.end());
+	}
+	ASSERT_EQUAL(page_sizes, (vector<size_t>{3, 3, 1}));
+	ASSERT_EQUAL(visited, (vector<int>{1, 2, 3, 4, 5, 6, 7}));
+	const vector<int> no_values;
+	const auto no_pages = Paginate(no_values, 2);
+	ASSERT(no_pages.begin() == no_pages.end());
+	ASSERT_EQUAL(no_pages.size(), 0);
+	try {
+		Paginate(values, 0);
+		ASSERT_HINT(false, "zero page size must be rejected"s);
+	} catch (const invalid_argument&) {
+	}
+}
+
+void TestSearchCursor() {
+	SearchServer server("and"s);
+	// Одинаковая релевантность и повторяющиеся рейтинги: порядок задают рейтинг и id
+	for (int id = 0; id < 23; ++id) {
+		server.AddDocument(id, "dog in the city"s, DocumentStatus::ACTUAL, {id % 4});
+	}
+	server.AddDocument(100, "dog dog"s, DocumentStatus::ACTUAL, {0});
+	server.AddDocument(101, "dog"s, DocumentStatus::BANNED, {0});
+
+	const auto query = server.PrepareQuery("dog"s);
+	const auto all_documents = server.FindTopDocumentsPage(query, nullptr, 1000,
+		[](int, DocumentStatus status, int) { return status == DocumentStatus::ACTUAL; });
+	ASSERT_EQUAL(all_documents.size(), 24);
+	ASSERT(is_sorted(all_documents.begin(), all_documents.end(), IsRankedBefore));
+
+	auto cursor = MakeSearchCursor(server, "dog"s, 5);
+	vector<int> paged_ids;
+	for (auto page = cursor.NextPage(); !page.empty(); page = cursor.NextPage()) {
+		ASSERT(page.size() <= 5);
+		for (const Document& document : page) {
+			paged_ids.push_back(document.id);
+		}
+	}
+	ASSERT(cursor.IsExhausted());
+	vector<int> expected_ids;
+	for (const Document& document : all_documents) {
+		expected_ids.push_back(document.id);
+	}
+	ASSERT_EQUAL(paged_ids, expected_ids);
+
+	// Страница после заданного документа
+	const auto page = server.FindTopDocumentsAfter(query, all_documents[9], 3,
+		[](int, DocumentStatus status, int) { return status == DocumentStatus::ACTUAL; });
+	ASSERT_EQUAL(page.size(), 3);
+	ASSERT_EQUAL(page[0].id, all_documents[10].id);
+	ASSERT_EQUAL(page[2].id, all_documents[12].id);
+
+	// Почти равные релевантности: соседние отличаются меньше чем на
+	// FLOAT_COMPARE_THRESHOLD, крайние — больше, а рейтинги убывают навстречу.
+	// Сравнение «с точностью до порога» здесь давало цикл
+	{
+		SearchServer near_tie_server(""s);
+		for (int id = 1; id <= 3; ++id) {
+			string text = "a"s;
+			for (int i = 1; i < 1303 - id; ++i) {
+				text += " w"s;
+			}
+			near_tie_server.AddDocument(id, text, DocumentStatus::ACTUAL, {15 - 5 * id});
+		}
+		for (int id = 4; id <= 8; ++id) {
+			near_tie_server.AddDocument(id, "b"s, DocumentStatus::ACTUAL, {0});
+		}
+		const auto top = near_tie_server.FindTopDocuments("a"s);
+		ASSERT_EQUAL(top.size(), 3);
+		vector<int> top_ids;
+		map<int, double> relevances;
+		for (const Document& document : top) {
+			top_ids.push_back(document.id);
+			relevances[document.id] = document.relevance;
+		}
+		ASSERT(relevances[2] - relevances[1] < FLOAT_COMPARE_THRESHOLD);
+		ASSERT(relevances[3] - relevances[2] < FLOAT_COMPARE_THRESHOLD);
+		ASSERT(relevances[3] - relevances[1] > FLOAT_COMPARE_THRESHOLD);
+		ASSERT(is_sorted(top.begin(), top.end(), IsRankedBefore));
+		for (const size_t page_size : {1u, 2u, 3u}) {
+			auto near_tie_cursor = MakeSearchCursor(near_tie_server, "a"s, page_size);
+			vector<int> near_tie_ids;
+			for (int pages = 0; pages < 10 && !near_tie_cursor.IsExhausted(); ++pages) {
+				for (const Document& document : near_tie_cursor.NextPage()) {
+					near_tie_ids.push_back(document.id);
+				}
+			}
+			ASSERT(near_tie_cursor.IsExhausted());
+			ASSERT_EQUAL(near_tie_ids, top_ids);
+		}
+	}
+}
+
+void TestSegmentedIndex() {
+	const vector<string> queries = {"cat"s, "fluffy groomed dog"s, "white tail -collar"s, "fancy -dog"s, "evgeny"s};
+
+	for (const bool background_merge : {false, true}) {
+		// Эталон без заморозки и индекс, который замораживается каждые 3 документа и сливает пары
+		SearchServer reference(INDEX_TEST_STOP_WORDS, IndexOptions{0, 2, background_merge});
+		SearchServer segmented(INDEX_TEST_STOP_WORDS, IndexOptions{3, 2, background_merge});
+		const auto check_same_results = [&] {
+			segmented.WaitForMerges();
+			for (const string& query : queries) {
+				AssertSameRanking(FindAllIndexTestDocuments(segmented, query), FindAllIndexTestDocuments(reference, query),
+					FLOAT_COMPARE_THRESHOLD);
+				for (const int document_id : reference) {
+					ASSERT(get<0>(segmented.MatchDocument(query, document_id)) == get<0>(reference.MatchDocument(query, document_id)));
+				}
+			}
+		};
+
+		AddIndexTestDocuments(reference, 0, 28);
+		AddIndexTestDocuments(segmented, 0, 28);
+		check_same_results();
+		ASSERT_EQUAL(reference.GetSegmentCount(), 0);
+		// 9 замороженных сегментов по 3 документа слились в сегменты размером 24 и 3
+		ASSERT_EQUAL(segmented.GetSegmentCount(), 2);
+
+		// Удаление из замороженных и изменяемого сегментов, повторное добавление того же id
+		const auto query = segmented.PrepareQuery("cat"s);
+		for (const int id : {0, 1, 5, 13, 27}) {
+			reference.RemoveDocument(id);
+			segmented.RemoveDocument(id);
+		}
+		ASSERT(segmented.IsStale(query));
+		reference.AddDocument(5, "fluffy evgeny"s, DocumentStatus::ACTUAL, {1});
+		segmented.AddDocument(5, "fluffy evgeny"s, DocumentStatus::ACTUAL, {1});
+		check_same_results();
+		ASSERT_EQUAL(segmented.GetDocumentCount(), reference.GetDocumentCount());
+
+		// Слияние сегментов с удалёнными документами отбрасывает их вхождения
+		AddIndexTestDocuments(reference, 100, 112);
+		AddIndexTestDocuments(segmented, 100, 112);
+		segmented.Flush();
+		check_same_results();
+		try {
+			segmented.MatchDocument("cat"s, 0);
+			ASSERT_HINT(false, "removed document must not be matched"s);
+		} catch (const out_of_range&) {
+		}
+
+		// Перемещённый сервер продолжает работу с тем же индексом и сливает сегменты
+		SearchServer moved(move(segmented));
+		ASSERT_EQUAL(segmented.GetDocumentCount(), 0);
+		ASSERT(is_sorted(reference.begin(), reference.end()));
+		ASSERT(equal(moved.begin(), moved.end(), reference.begin(), reference.end()));
+		AddIndexTestDocuments(reference, 200, 207);
+		AddIndexTestDocuments(moved, 200, 207);
+		reference.RemoveDocument(100);
+		moved.RemoveDocument(100);
+		moved.WaitForMerges();
+		for (const string& query : queries) {
+			AssertSameRanking(FindAllIndexTestDocuments(moved, query), FindAllIndexTestDocuments(reference, query),
+				FLOAT_COMPARE_THRESHOLD);
+		}
+
+		// Удаление переводит сегмент размером 4 на нижний уровень к сегменту размером 2,
+		// и ожидание слияний должно дождаться их слияния, а не зависнуть
+		SearchServer tiered(""s, IndexOptions{2, 2, background_merge});
+		for (int id = 0; id < 6; ++id) {
+			tiered.AddDocument(id, "cat dog"s, DocumentStatus::ACTUAL, {id});
+		}
+		tiered.WaitForMerges();
+		ASSERT_EQUAL(tiered.GetSegmentCount(), 2);
+		tiered.RemoveDocument(0);
+		tiered.WaitForMerges();
+		ASSERT_EQUAL(tiered.GetSegmentCount(), 1);
+		ASSERT_EQUAL(tiered.FindTopDocuments("cat"s).size(), 5);
+	}
+}
+
+void TestWriteAheadLogRecovery() {
+	const string directory = (filesystem::temp_directory_path() / "search_server_wal_test"s).string();
+	const string wal_path = directory + "/search_server.wal"s;
+	filesystem::remove_all(directory);
+	const auto read_file = [](const string& path) {
+		ifstream input(path, ios::binary);
+		return string{istreambuf_iterator<char>(input), istreambuf_iterator<char>()};
+	};
+	const auto write_file = [](const string& path, const string& data) {
+		ofstream(path, ios::binary | ios::trunc) << data;
+	};
+	const auto results = [](const SearchServer& server) {
+		return server.FindTopDocumentsPage(server.PrepareQuery("curly cat dog"s), nullptr, 100,
+			[](int, DocumentStatus, int) { return true; });
+	};
+
+	vector<Document> expected;
+	{
+		SearchServer server("and in"s);
+		DurableSearchServer durable(server, directory, WalOptions{WalSyncPolicy::EVERY_RECORD});
+		durable.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+		durable.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::BANNED, {1, 2, 3});
+		durable.AddDocument(3, "big cat fancy collar"s, DocumentStatus::ACTUAL, {1, 2, 8});
+		durable.RemoveDocument(1);
+		// Отклонённый сервером документ в журнал не попадает
+		try {
+			durable.AddDocument(3, "duplicate"s, DocumentStatus::ACTUAL, {});
+			ASSERT_HINT(false, "duplicate id must be rejected"s);
+		} catch (const invalid_argument&) {
+		}
+		ASSERT_EQUAL(durable.GetWalStats().records, 4u);
+		ASSERT_EQUAL(durable.GetWalStats().syncs, 4u);
+		expected = results(server);
+	}
+	{
+		SearchServer server("and in"s);
+		DurableSearchServer durable(server, directory);
+		ASSERT_EQUAL(durable.GetRecoveryStats().replayed_records, 4u);
+		ASSERT_EQUAL(server.GetDocumentCount(), 2);
+		ASSERT_EQUAL(results(server).size(), expected.size());
+		ASSERT_EQUAL(results(server)[0].id, expected[0].id);
+
+		// Снимок с той же выдачей, журнал очищается
+		durable.Checkpoint();
+		durable.AddDocument(4, "fluffy dog"s, DocumentStatus::ACTUAL, {5});
+		durable.Commit();
+		expected = results(server);
+	}
+	const string wal_after_checkpoint = read_file(wal_path);
+	{
+		SearchServer server("and in"s);
+		DurableSearchServer durable(server, directory);
+		ASSERT_EQUAL(durable.GetRecoveryStats().snapshot_documents, 2u);
+		ASSERT_EQUAL(durable.GetRecoveryStats().replayed_records, 1u);
+		const auto recovered = results(server);
+		ASSERT_EQUAL(recovered.size(), expected.size());
+		for (size_t i = 0; i < expected.size(); ++i) {
+			ASSERT_EQUAL(recovered[i].id, expected[i].id);
+			ASSERT_EQUAL(recovered[i].relevance, expected[i].relevance);
+			ASSERT_EQUAL(recovered[i].rating, expected[i].rating);
+		}
+	}
+
+	// Недописанная последняя запись отрезается, остальные применяются
+	write_file(wal_path, wal_after_checkpoint + wal_after_checkpoint.substr(8, 11));
+	{
+		SearchServer server("and in"s);
+		DurableSearchServer durable(server, directory);
+		ASSERT_EQUAL(durable.GetRecoveryStats().replayed_records, 1u);
+		ASSERT_EQUAL(durable.GetRecoveryStats().truncated_bytes, 11u);
+		ASSERT_EQUAL(server.GetDocumentCount(), 3);
+	}
+	ASSERT_EQUAL(read_file(wal_path), wal_after_checkpoint);
+
+	// Запись с неверной контрольной суммой и всё после неё отбрасываются
+	string corrupted = wal_after_checkpoint;
+	corrupted.back() ^= 1;
+	write_file(wal_path, corrupted);
+	{
+		SearchServer server("and in"s);
+		DurableSearchServer durable(server, directory);
+		ASSERT_EQUAL(durable.GetRecoveryStats().replayed_records, 0u);
+		ASSERT_EQUAL(server.GetDocumentCount(), 2);
+
+		// Падение между сохранением снимка и очисткой журнала: записи из снимка пропускаются
+		durable.AddDocument(5, "curly parrot"s, DocumentStatus::ACTUAL, {1});
+		durable.Commit();
+		const string wal_before_checkpoint = read_file(wal_path);
+		durable.Checkpoint();
+		write_file(wal_path, wal_before_checkpoint);
+	}
+	{
+		SearchServer server("and in"s);
+		DurableSearchServer durable(server, directory);
+		ASSERT_EQUAL(durable.GetRecoveryStats().skipped_records, 1u);
+		ASSERT_EQUAL(durable.GetRecoveryStats().replayed_records, 0u);
+		ASSERT_EQUAL(server.GetDocumentCount(), 3);
+	}
+
+	// Неполная группа записывается по сроку без Commit и новых записей;
+	// копия файла — то, что увидит восстановление после падения
+	filesystem::remove_all(directory);
+	{
+		WalOptions delayed_options;
+		delayed_options.group_commit_delay = chrono::milliseconds(20);
+		SearchServer delayed_server("and in"s);
+		DurableSearchServer delayed(delayed_server, directory, delayed_options);
+		delayed.AddDocument(7, "fluffy parrot"s, DocumentStatus::ACTUAL, {2});
+		const auto give_up = chrono::steady_clock::now() + chrono::seconds(10);
+		while (delayed.GetWalStats().commits == 0 && chrono::steady_clock::now() < give_up) {
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		ASSERT_EQUAL(delayed.GetWalStats().commits, 1u);
+		ASSERT_EQUAL(delayed.GetWalStats().syncs, 1u);
+		const string crash_copy = directory + "/crash_copy.wal"s;
+		write_file(crash_copy, read_file(wal_path));
+		vector<int> replayed_ids;
+		ReplayWriteAheadLog(crash_copy, [&replayed_ids](const WalRecord& record) {
+			replayed_ids.push_back(record.document_id);
+		});
+		ASSERT_EQUAL(replayed_ids, vector<int>{7});
+	}
+
+	// Нехватку места имитирует ограничение размера файла: write() записывает
+	// часть данных до предела и возвращает EFBIG вместо сигнала SIGXFSZ
+	const auto with_file_size_limit = [&wal_path](uintmax_t free_bytes, const auto& action) {
+		const auto previous_handler = signal(SIGXFSZ, SIG_IGN);
+		rlimit previous_limit;
+		getrlimit(RLIMIT_FSIZE, &previous_limit);
+		rlimit limit = previous_limit;
+		limit.rlim_cur = filesystem::file_size(wal_path) + free_bytes;
+		setrlimit(RLIMIT_FSIZE, &limit);
+		try {
+			action();
+			ASSERT_HINT(false, "write past the file size limit must fail"s);
+		} catch (const system_error&) {
+		}
+		setrlimit(RLIMIT_FSIZE, &previous_limit);
+		signal(SIGXFSZ, previous_handler);
+	};
+	const auto replay_ids = [&wal_path] {
+		vector<int> replayed_ids;
+		const auto replay_stats = ReplayWriteAheadLog(wal_path, [&replayed_ids](const WalRecord& record) {
+			replayed_ids.push_back(record.document_id);
+		});
+		ASSERT_EQUAL(replay_stats.truncated_bytes, 0u);
+		return replayed_ids;
+	};
+
+	// write() записал часть группы и упал: повторный Commit дописывает только остаток
+	filesystem::remove_all(directory);
+	filesystem::create_directories(directory);
+	{
+		WalOptions group_options;
+		group_options.group_commit_delay = chrono::seconds(60);
+		WriteAheadLog log(wal_path, group_options);
+		WalRecord record;
+		record.document = "fluffy parrot"s;
+		for (const int id : {1, 2}) {
+			record.sequence = id;
+			record.document_id = id;
+			log.Append(record);
+		}
+		with_file_size_limit(20, [&log] {
+			log.Commit();
+		});
+		log.Commit();
+	}
+	ASSERT_EQUAL(replay_ids(), (vector<int>{1, 2}));
+
+	// Append, который не смог записать свою запись, не оставляет её в журнале
+	filesystem::remove_all(directory);
+	filesystem::create_directories(directory);
+	{
+		WriteAheadLog log(wal_path, WalOptions{WalSyncPolicy::EVERY_RECORD});
+		WalRecord record;
+		record.document = "fluffy parrot"s;
+		with_file_size_limit(20, [&log, &record] {
+			record.sequence = 1;
+			record.document_id = 1;
+			log.Append(record);
+		});
+		ASSERT_EQUAL(log.GetStats().records, 0u);
+		record.sequence = 2;
+		record.document_id = 2;
+		log.Append(record);
+	}
+	ASSERT_EQUAL(replay_ids(), vector<int>{2});
+
+	// Добавление, не попавшее в журнал, откатывается в сервере
+	filesystem::remove_all(directory);
+	{
+		SearchServer server("and in"s);
+		DurableSearchServer durable(server, directory, WalOptions{WalSyncPolicy::EVERY_RECORD});
+		durable.AddDocument(1, "curly cat"s, DocumentStatus::ACTUAL, {1});
+		with_file_size_limit(20, [&durable] {
+			durable.AddDocument(2, "fluffy parrot"s, DocumentStatus::ACTUAL, {2});
+		});
+		ASSERT_EQUAL(server.GetDocumentCount(), 1);
+		ASSERT(server.FindTopDocuments("parrot"s).empty());
+		durable.AddDocument(2, "fluffy parrot"s, DocumentStatus::ACTUAL, {2});
+		durable.RemoveDocument(1);
+	}
+	{
+		SearchServer server("and in"s);
+		DurableSearchServer durable(server, directory);
+		ASSERT_EQUAL(durable.GetRecoveryStats().replayed_records, 3u);
+		ASSERT_EQUAL(durable.GetRecoveryStats().truncated_bytes, 0u);
+		ASSERT_EQUAL(server.GetDocumentCount(), 1);
+		ASSERT_EQUAL(server.FindTopDocuments("parrot"s).size(), 1u);
+	}
+	filesystem::remove_all(directory);
+}
+
+void TestForwardIndexModes() {
+	const ForwardIndexMode modes[] = {ForwardIndexMode::FULL, ForwardIndexMode::COMPACT, ForwardIndexMode::NONE};
+	vector<unique_ptr<SearchServer>> servers;
+	for (const ForwardIndexMode mode : modes) {
+		// Часть документов в изменяемом сегменте, часть — в неизменяемых
+		servers.push_back(make_unique<SearchServer>(INDEX_TEST_STOP_WORDS, IndexOptions{3, 2, false, mode}));
+		AddIndexTestDocuments(*servers.back(), 0, 11);
+		servers.back()->RemoveDocument(1);
+		servers.back()->RemoveDocument(10);
+	}
+	const SearchServer& full = *servers[0];
+	ASSERT(full.GetWordFrequencies(1).empty());
+	ASSERT_EQUAL(full.GetWordFrequencies(0).size(), 4u);
+	for (const auto& server : servers) {
+		ASSERT_EQUAL(server->GetDocumentCount(), full.GetDocumentCount());
+		for (int id = 0; id < 12; ++id) {
+			ASSERT(server->CollectWordFrequencies(id) == full.GetWordFrequencies(id));
+		}
+		AssertSameRanking(FindAllIndexTestDocuments(*server, "fluffy white cat"s),
+			FindAllIndexTestDocuments(full, "fluffy white cat"s), 0.0);
+
+		// Снимок не зависит от режима прямого индекса
+		string snapshot;
+		server->SaveSnapshot(snapshot);
+		SearchServer restored(INDEX_TEST_STOP_WORDS);
+		restored.LoadSnapshot(snapshot);
+		for (int id = 0; id < 12; ++id) {
+			ASSERT(restored.GetWordFrequencies(id) == full.GetWordFrequencies(id));
+		}
+	}
+	try {
+		servers[1]->GetWordFrequencies(0);
+		ASSERT_HINT(false, "word frequencies are stored only in FULL mode"s);
+	} catch (const invalid_argument&) {
+	}
+	ASSERT(servers[1]->GetMemoryStats().forward_index_bytes < servers[0]->GetMemoryStats().forward_index_bytes);
+	ASSERT_EQUAL(servers[2]->GetMemoryStats().forward_index_bytes, 0u);
+}
+
+void TestMemoryStats() {
+	// Длинное уникальное слово не помещается в строку без выделения памяти
+	const auto add_documents = [](SearchServer& server, int document_count) {
+		for (int id = 0; id < document_count; ++id) {
+			server.AddDocument(id, GetIndexTestText(id) + " document"s + to_string(id) + "_with_unique_long_word"s,
+				DocumentStatus::ACTUAL, {id});
+		}
+	};
+	for (const ForwardIndexMode mode : {ForwardIndexMode::FULL, ForwardIndexMode::COMPACT}) {
+		SearchServer server(INDEX_TEST_STOP_WORDS, IndexOptions{0, 4, false, mode});
+		SearchServer reference(INDEX_TEST_STOP_WORDS, IndexOptions{0, 4, false, mode});
+		add_documents(server, 10);
+		add_documents(reference, 5);
+
+		const IndexMemoryStats stats = server.GetMemoryStats();
+		// 13 общих слов и по уникальному слову на документ
+		ASSERT_EQUAL(stats.terms, 23u);
+		ASSERT_EQUAL(stats.documents, 10u);
+		ASSERT_EQUAL(stats.postings, 43u);
+		ASSERT(abs(stats.average_posting_length - 43.0 / 23) < 1e-9);
+		ASSERT(stats.forward_index_bytes > 0 && stats.postings_bytes > 0 && stats.stop_words_bytes > 0);
+		ASSERT_EQUAL(stats.GetTotalBytes(), stats.term_dictionary_bytes + stats.postings_bytes + stats.forward_index_bytes
+			+ stats.document_table_bytes + stats.stop_words_bytes + stats.tombstone_bytes);
+
+		// Счётчики, которые ведутся при удалении, совпадают с индексом, где этих документов не было
+		for (int id = 5; id < 10; ++id) {
+			server.RemoveDocument(id);
+		}
+		const IndexMemoryStats after_remove = server.GetMemoryStats();
+		const IndexMemoryStats expected = reference.GetMemoryStats();
+		ASSERT_EQUAL(after_remove.terms, expected.terms);
+		ASSERT_EQUAL(after_remove.postings, expected.postings);
+		ASSERT_EQUAL(after_remove.postings_bytes, expected.postings_bytes);
+		ASSERT_EQUAL(after_remove.forward_index_bytes, expected.forward_index_bytes);
+
+		// После заморозки вхождения учитываются в сегменте, удаления — в tombstones
+		server.Flush();
+		server.RemoveDocument(0);
+		const IndexMemoryStats frozen = server.GetMemoryStats();
+		ASSERT_EQUAL(frozen.segments, 1u);
+		ASSERT_EQUAL(frozen.postings, expected.postings);
+		ASSERT(frozen.tombstone_bytes > 0);
+	}
+
+	SearchServer server("and"s);
+	server.AddDocument(1, "curly cat"s, DocumentStatus::ACTUAL, {1});
+	RequestQueue request_queue(server);
+	const size_t empty_queue_bytes = request_queue.GetMemoryUsage();
+	for (int i = 0; i < 1440; ++i) {
+		request_queue.AddFindRequest("curly cat and a reasonably long query"s);
+	}
+	const size_t full_queue_bytes = request_queue.GetMemoryUsage();
+	ASSERT(full_queue_bytes > empty_queue_bytes);
+	for (int i = 0; i < 100; ++i) {
+		request_queue.AddFindRequest("curly cat and a reasonably long query"s);
+	}
+	// Старые запросы вытесняются, память не растёт
+	ASSERT_EQUAL(request_queue.GetMemoryUsage(), full_queue_bytes);
+}
+
+void TestBatchQueries() {
+	SearchServer server("and in"s, IndexOptions{4, 2, false});
+	const vector<string> texts = {
+		"curly cat curly tail"s, "curly dog and fancy collar"s, "big cat fancy collar"s,
+		"big dog sparrow eugene"s, "big dog sparrow vasiliy"s, "fluffy cat in the city"s,
+	};
+	for (int id = 0; id < 30; ++id) {
+		server.AddDocument(id, texts[id % texts.size()], id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL,
+			{id % 7});
+	}
+	server.RemoveDocument(3);
+	// Запросы пересекаются по словам, есть минус-слова, повторы и пустая выдача
+	const vector<string> raw_queries = {
+		"curly cat"s, "cat -collar"s, "big dog sparrow"s, "curly cat"s, "fancy -big -curly"s, "parrot"s, "dog city"s,
+	};
+	const auto check_batch = [&](const vector<vector<Document>>& batch_results, DocumentStatus status) {
+		ASSERT_EQUAL(batch_results.size(), raw_queries.size());
+		for (size_t i = 0; i < raw_queries.size(); ++i) {
+			const auto expected = server.FindTopDocuments(raw_queries[i], status);
+			ASSERT_EQUAL(batch_results[i].size(), expected.size());
+			for (size_t j = 0; j < expected.size(); ++j) {
+				ASSERT_EQUAL(batch_results[i][j].id, expected[j].id);
+				ASSERT_EQUAL(batch_results[i][j].relevance, expected[j].relevance);
+				ASSERT_EQUAL(batch_results[i][j].rating, expected[j].rating);
+			}
+		}
+	};
+	check_batch(server.FindTopDocumentsBatch(raw_queries), DocumentStatus::ACTUAL);
+	check_batch(server.FindTopDocumentsBatch(raw_queries, DocumentStatus::BANNED), DocumentStatus::BANNED);
+
+	// Подготовленные запросы, устаревшие после изменения индекса, обновляются
+	vector<SearchServer::PreparedQuery> queries;
+	for (const string& raw_query : raw_queries) {
+		queries.push_back(server.PrepareQuery(raw_query));
+	}
+	server.AddDocument(100, "curly parrot"s, DocumentStatus::ACTUAL, {9});
+	check_batch(server.FindTopDocumentsBatch(queries), DocumentStatus::ACTUAL);
+	ASSERT(server.FindTopDocumentsBatch(vector<string>{}).empty());
+	try {
+		server.FindTopDocumentsBatch(vector<string>{"cat"s, "--dog"s});
+		ASSERT_HINT(false, "invalid query must be rejected"s);
+	} catch (const invalid_argument&) {
+	}
+}
+
+void TestSearchBudget() {
+	SearchServer server("and in"s, IndexOptions{8, 2, false});
+	// Частое слово cat в каждом документе, редкие parrot и collar — в одном
+	for (int id = 0; id < 40; ++id) {
+		server.AddDocument(id, "cat number"s + to_string(id), DocumentStatus::ACTUAL, {id % 5});
+	}
+	server.AddDocument(100, "cat parrot"s, DocumentStatus::ACTUAL, {1});
+	server.AddDocument(101, "cat parrot collar"s, DocumentStatus::ACTUAL, {2});
+	server.AddDocument(102, "cat collar"s, DocumentStatus::ACTUAL, {3});
+
+	// Без ограничений — та же выдача, что и у FindTopDocuments
+	const auto full = server.FindTopDocumentsWithBudget("cat parrot -collar"s, SearchBudget{});
+	const auto expected = server.FindTopDocuments("cat parrot -collar"s);
+	ASSERT(!full.partial);
+	ASSERT_EQUAL(full.postings_scanned, 45u);
+	ASSERT_EQUAL(full.documents.size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i) {
+		ASSERT_EQUAL(full.documents[i].id, expected[i].id);
+		ASSERT(abs(full.documents[i].relevance - expected[i].relevance) < FLOAT_COMPARE_THRESHOLD);
+	}
+
+	// Бюджет хватает только на редкое слово; минус-слово всё равно применяется
+	SearchBudget postings_budget;
+	postings_budget.max_postings = 2;
+	const auto partial = server.FindTopDocumentsWithBudget("cat parrot -collar"s, postings_budget);
+	ASSERT(partial.partial);
+	ASSERT_EQUAL(partial.postings_scanned, 2u);
+	ASSERT_EQUAL(partial.documents.size(), 1u);
+	ASSERT_EQUAL(partial.documents[0].id, 100);
+
+	// Бюджет ровно на все вхождения — выдача полная
+	postings_budget.max_postings = 45;
+	ASSERT(!server.FindTopDocumentsWithBudget("cat parrot -collar"s, postings_budget).partial);
+
+	// Истёкший срок останавливает подсчёт до первого вхождения
+	SearchBudget deadline_budget;
+	deadline_budget.deadline = chrono::steady_clock::now() - chrono::milliseconds(1);
+	const auto expired = server.FindTopDocumentsWithBudget("cat parrot"s, deadline_budget);
+	ASSERT(expired.partial);
+	ASSERT(expired.documents.empty());
+	ASSERT_EQUAL(expired.postings_scanned, 0u);
+}
+
+void TestThreadPool() {
+	atomic<int> sum = 0;
+	ThreadPoolStats stats;
+	{
+		ThreadPool pool(3);
+		for (int i = 1; i <= 100; ++i) {
+			pool.Submit([&sum, &pool, i] {
+				// Вложенная задача попадает в очередь того же потока
+				pool.Submit([&sum, i] {
+					sum += i;
+				});
+			});
+		}
+		while (pool.GetStats().executed < 200) {
+			this_thread::yield();
+		}
+		stats = pool.GetStats();
+	}
+	ASSERT_EQUAL(sum.load(), 5050);
+	ASSERT_EQUAL(stats.executed, 200u);
+
+	try {
+		ThreadPool empty_pool(0);
+		ASSERT_HINT(false, "pool without threads must be rejected"s);
+	} catch (const invalid_argument&) {
+	}
+}
+
+void TestQueryServer() {
+	SearchServer server("and in"s);
+	server.AddDocument(1, "white cat fancy collar"s, DocumentStatus::ACTUAL, {8, -3});
+	server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+	server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {5, -12, 2, 1});
+
+	QueryServerOptions options;
+	options.unix_socket_path = (filesystem::temp_directory_path() / "search_server_test.sock"s).string();
+	options.threads = 2;
+	options.max_batch_size = 2;
+	QueryServer query_server(server, options);
+	thread loop([&query_server] {
+		query_server.Run();
+	});
+
+	const int client = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	options.unix_socket_path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+	ASSERT(connect(client, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+
+	// Все запросы уходят сразу, не дожидаясь ответов
+	const string requests = "FIND fluffy cat\nFIND dog\nFIND cat --tail\nFIND parrot\r\nHELLO\nFIND cat -dog\nSTATS\n"s;
+	ASSERT_EQUAL(send(client, requests.data(), requests.size(), 0), static_cast<ssize_t>(requests.size()));
+	string received;
+	char buffer[4096];
+	while (count(received.begin(), received.end(), '\n') < 7) {
+		const ssize_t size = recv(client, buffer, sizeof(buffer), 0);
+		ASSERT(size > 0);
+		received.append(buffer, static_cast<size_t>(size));
+	}
+	close(client);
+	query_server.Stop();
+	loop.join();
+
+	vector<string> lines;
+	for (size_t begin = 0, end; (end = received.find('\n', begin)) != string::npos; begin = end + 1) {
+		lines.push_back(received.substr(begin, end - begin));
+	}
+	ASSERT_EQUAL(lines.size(), 7u);
+	// Ответы идут в порядке запросов, хотя пакеты выполняются параллельно
+	ASSERT_EQUAL(lines[0].substr(0, 7), "OK 2 2:"s);
+	ASSERT_EQUAL(lines[1].substr(0, 7), "OK 1 3:"s);
+	ASSERT_EQUAL(lines[2], "ERROR Invalid query"s);
+	ASSERT_EQUAL(lines[3], "OK 0"s);
+	ASSERT_EQUAL(lines[4], "ERROR unknown command"s);
+	ASSERT_EQUAL(lines[5].substr(0, 4), "OK 2"s);
+	ASSERT(lines[5].find(" 3:"s) == string::npos);
+	// STATS видит все запросы соединения, отправленные до него
+	ASSERT(lines[6].find(" requests=6 "s) != string::npos);
+	ASSERT(lines[6].find(" errors=2 "s) != string::npos);
+	ASSERT(lines[6].find(" no_result=1 "s) != string::npos);
+
+	const QueryServerStats& stats = query_server.GetStats();
+	ASSERT_EQUAL(stats.connections, 1u);
+	ASSERT_EQUAL(stats.requests, 7u);
+	ASSERT_EQUAL(stats.bytes_read, requests.size());
+	ASSERT_EQUAL(stats.bytes_written, received.size());
+	// Пять FIND при пакетах по два
+	ASSERT(stats.batches >= 3);
+}
+
+void TestTermFreqPrecision() {
+	const TermFreqPrecision precisions[] = {TermFreqPrecision::DOUBLE, TermFreqPrecision::FLOAT,
+	                                        TermFreqPrecision::QUANTIZED};
+	IndexSegment::MutablePostings postings;
+	set<int> document_ids;
+	for (int id = 0; id < 37; ++id) {
+		postings["cat"s][id] = 1.0 / (1 + id % 7);
+		document_ids.insert(id);
+	}
+	vector<size_t> postings_bytes;
+	for (const TermFreqPrecision precision : precisions) {
+		const IndexSegment segment(postings, document_ids, precision);
+		postings_bytes.push_back(segment.GetPostingsMemoryUsage());
+		const PostingSpan span = segment.FindPostings("cat"s);
+		ASSERT_EQUAL(span.size(), 37u);
+		vector<double> expected(span.size());
+		span.ComputeScores(0, span.size(), 2.5, expected.data(), SimdLevel::SCALAR);
+		for (size_t i = 0; i < span.size(); ++i) {
+			ASSERT_EQUAL(span.GetDocumentId(i), static_cast<int>(i));
+			ASSERT(abs(expected[i] - 2.5 * postings["cat"s][static_cast<int>(i)]) < 2e-5);
+			ASSERT(abs(expected[i] - 2.5 * span.GetTermFreq(i)) < 1e-12);
+		}
+		// Векторные ядра дают те же биты, в том числе на невыровненном начале и хвосте
+		for (const SimdLevel level : {SimdLevel::SSE2, SimdLevel::AVX2}) {
+			vector<double> scores(span.size());
+			span.ComputeScores(0, span.size(), 2.5, scores.data(), level);
+			ASSERT_HINT(scores == expected, ToString(level));
+			span.ComputeScores(3, 30, 2.5, scores.data(), level);
+			ASSERT_HINT(equal(scores.begin(), scores.begin() + 30, expected.begin() + 3), ToString(level));
+		}
+	}
+	ASSERT(postings_bytes[0] > postings_bytes[1] && postings_bytes[1] > postings_bytes[2]);
+
+	// Одинаковые документы попадают в разные сегменты и в изменяемый сегмент,
+	// но остаются равными по релевантности, поэтому порядок выдачи не меняется
+	SearchServer exact(INDEX_TEST_STOP_WORDS, IndexOptions{3, 2, false});
+	AddIndexTestDocuments(exact, 0, 23);
+	for (const TermFreqPrecision precision : precisions) {
+		SearchServer server(INDEX_TEST_STOP_WORDS, IndexOptions{3, 2, false, ForwardIndexMode::FULL, precision});
+		AddIndexTestDocuments(server, 0, 23);
+		ASSERT(server.GetSegmentCount() > 1);
+		for (const string& query : {"fluffy white cat"s, "fancy tail -dog"s, "groomed evgeny eyes"s}) {
+			AssertSameRanking(FindAllIndexTestDocuments(server, query), FindAllIndexTestDocuments(exact, query), 1e-4);
+		}
+	}
+}
+
 void TestSearchServer() {
 	RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
 	RUN_TEST(TestAddDocument);
@@ -346,4 +1251,19 @@ void TestSearchServer() {
 	RUN_TEST(TestCalculateRalavance);
     RUN_TEST(TestResultPagination);
 	RUN_TEST(TestRequestQueueStore);
+	RUN_TEST(TestTokenizerSimdMatchesScalar);
+	RUN_TEST(TestInvalidWordsRejected);
+	RUN_TEST(TestStopWordsPerfectHash);
+	RUN_TEST(TestPreparedQuery);
+	RUN_TEST(TestLazyPaginator);
+	RUN_TEST(TestSearchCursor);
+	RUN_TEST(TestSegmentedIndex);
+	RUN_TEST(TestWriteAheadLogRecovery);
+	RUN_TEST(TestForwardIndexModes);
+	RUN_TEST(TestMemoryStats);
+	RUN_TEST(TestBatchQueries);
+	RUN_TEST(TestSearchBudget);
+	RUN_TEST(TestThreadPool);
+	RUN_TEST(TestQueryServer);
+	RUN_TEST(TestTermFreqPrecision);
 }
\ No newline at end of file
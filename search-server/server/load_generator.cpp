@@ -0,0 +1,284 @@
+// Нагрузочный клиент для search_query_server: несколько соединений, в каждом
+// до --depth запросов без ожидания ответа. Печатает пропускную способность и
+// перцентили задержки одной строкой JSON, как бенчмарки.
+//
+// Сборка: цель search_load_generator в CMakeLists.txt.
+//
+// Запуск:
+//   ./search_load_generator --unix /tmp/search.sock --connections 8 --depth 32 --requests 200000
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../benchmark/benchmark_utils.h"
+#include "../benchmark/corpus_generator.h"
+
+using namespace std;
+
+namespace {
+
+struct LoadConfig {
+    string unix_socket_path;
+    uint16_t tcp_port = 0;
+    size_t connections = 4;
+    size_t depth = 16;
+    size_t requests = 100000;
+    // Файл с запросами (по одному на строку); без него запросы синтетические,
+    // с тем же словарём, что и у search_query_server --synthetic
+    string queries_path;
+    size_t query_count = 10000;
+    uint64_t seed = 42;
+    size_t vocabulary_size = 50000;
+};
+
+LoadConfig ParseArguments(int argc, char** argv) {
+    LoadConfig config;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw invalid_argument("missing value for "s + arg);
+        }
+        const string value = argv[++i];
+        if (arg == "--unix"s) {
+            config.unix_socket_path = value;
+        } else if (arg == "--port"s) {
+            config.tcp_port = static_cast<uint16_t>(stoul(value));
+        } else if (arg == "--connections"s) {
+            config.connections = max<size_t>(1, stoull(value));
+        } else if (arg == "--depth"s) {
+            config.depth = max<size_t>(1, stoull(value));
+        } else if (arg == "--requests"s) {
+            config.requests = stoull(value);
+        } else if (arg == "--queries"s) {
+            config.queries_path = value;
+        } else if (arg == "--seed"s) {
+            config.seed = stoull(value);
+        } else if (arg == "--vocabulary"s) {
+            config.vocabulary_size = stoull(value);
+        } else {
+            throw invalid_argument("unknown option "s + arg);
+        }
+    }
+    if (config.unix_socket_path.empty() && config.tcp_port == 0) {
+        throw invalid_argument("one of --unix or --port is required"s);
+    }
+    return config;
+}
+
+vector<string> LoadQueries(const LoadConfig& config) {
+    vector<string> queries;
+    if (!config.queries_path.empty()) {
+        ifstream input(config.queries_path);
+        if (!input) {
+            throw invalid_argument("cannot open "s + config.queries_path);
+        }
+        for (string line; getline(input, line);) {
+            queries.push_back(move(line));
+        }
+    } else {
+        CorpusGenerator::Options options;
+        options.seed = config.seed;
+        options.vocabulary_size = config.vocabulary_size;
+        CorpusGenerator generator(options);
+        for (size_t i = 0; i < config.query_count; ++i) {
+            queries.push_back(generator.GenerateQuery(1 + i % 5, i % 3 == 0 ? 1 : 0));
+        }
+    }
+    if (queries.empty()) {
+        throw invalid_argument("no queries to send"s);
+    }
+    return queries;
+}
+
+int Connect(const LoadConfig& config) {
+    int client;
+    int result;
+    if (!config.unix_socket_path.empty()) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        config.unix_socket_path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+        client = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        result = client < 0 ? -1 : connect(client, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    } else {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(config.tcp_port);
+        client = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        result = client < 0 ? -1 : connect(client, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+        if (result == 0) {
+            const int enable = 1;
+            setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+    }
+    if (result != 0) {
+        const int error = errno;
+        if (client >= 0) {
+            close(client);
+        }
+        throw system_error(error, generic_category(), "cannot connect to query server"s);
+    }
+    return client;
+}
+
+// Блокирующее соединение с построчным чтением ответов
+class Client {
+public:
+    explicit Client(const LoadConfig& config)
+        : socket_(Connect(config)) {
+    }
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    ~Client() {
+        close(socket_);
+    }
+
+    void Send(const string& data) {
+        for (size_t sent = 0; sent < data.size();) {
+            const ssize_t result = send(socket_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw system_error(errno, generic_category(), "cannot send request"s);
+            }
+            sent += static_cast<size_t>(result);
+        }
+    }
+
+    string ReadLine() {
+        while (true) {
+            const size_t end = buffer_.find('\n', position_);
+            if (end != string::npos) {
+                string line = buffer_.substr(position_, end - position_);
+                position_ = end + 1;
+                return line;
+            }
+            buffer_.erase(0, position_);
+            position_ = 0;
+            char chunk[64 * 1024];
+            const ssize_t received = recv(socket_, chunk, sizeof(chunk), 0);
+            if (received == 0) {
+                throw runtime_error("query server closed the connection"s);
+            }
+            if (received < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw system_error(errno, generic_category(), "cannot read response"s);
+            }
+            buffer_.append(chunk, static_cast<size_t>(received));
+        }
+    }
+
+private:
+    int socket_;
+    string buffer_;
+    size_t position_ = 0;
+};
+
+struct ConnectionResult {
+    vector<chrono::nanoseconds> latencies;
+    size_t errors = 0;
+    string failure;
+};
+
+// Держит в полёте до depth запросов: каждый ответ освобождает место для следующего
+void RunConnection(const LoadConfig& config, const vector<string>& queries, size_t first_query,
+                   size_t request_count, ConnectionResult& result) {
+    try {
+        Client client(config);
+        deque<Stopwatch::Clock::time_point> sent_at;
+        result.latencies.reserve(request_count);
+        size_t sent = 0;
+        while (result.latencies.size() < request_count) {
+            // Всё, что помещается в окно, уходит одной записью
+            string requests;
+            for (; sent < request_count && sent_at.size() < config.depth; ++sent) {
+                requests += "FIND "s + queries[(first_query + sent) % queries.size()] + '\n';
+                sent_at.push_back(Stopwatch::Clock::now());
+            }
+            if (!requests.empty()) {
+                client.Send(requests);
+            }
+            const string response = client.ReadLine();
+            result.latencies.push_back(Stopwatch::Clock::now() - sent_at.front());
+            sent_at.pop_front();
+            if (response.rfind("OK"s, 0) != 0) {
+                ++result.errors;
+            }
+        }
+    } catch (const exception& e) {
+        result.failure = e.what();
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    try {
+        const LoadConfig config = ParseArguments(argc, argv);
+        const vector<string> queries = LoadQueries(config);
+
+        vector<ConnectionResult> results(config.connections);
+        vector<thread> threads;
+        Stopwatch stopwatch;
+        for (size_t i = 0; i < config.connections; ++i) {
+            const size_t request_count = config.requests / config.connections
+                                         + (i < config.requests % config.connections ? 1 : 0);
+            threads.emplace_back(RunConnection, cref(config), cref(queries), i * queries.size() / config.connections,
+                                 request_count, ref(results[i]));
+        }
+        for (thread& worker : threads) {
+            worker.join();
+        }
+        const auto elapsed = stopwatch.Elapsed();
+
+        vector<chrono::nanoseconds> latencies;
+        size_t errors = 0;
+        for (const ConnectionResult& connection : results) {
+            if (!connection.failure.empty()) {
+                throw runtime_error(connection.failure);
+            }
+            latencies.insert(latencies.end(), connection.latencies.begin(), connection.latencies.end());
+            errors += connection.errors;
+        }
+
+        Client stats_client(config);
+        stats_client.Send("STATS\n"s);
+        const string server_stats = stats_client.ReadLine();
+
+        BenchmarkResult result{"QueryServer"s};
+        result.operations = latencies.size();
+        result.elapsed = elapsed;
+        result.Label("transport", config.unix_socket_path.empty() ? "tcp"s : "unix"s)
+              .Label("connections", config.connections)
+              .Label("depth", config.depth)
+              .Label("server_stats", server_stats);
+        AddLatencyMetrics(result, latencies);
+        result.Metric("errors", static_cast<double>(errors));
+        PrintResult(cout, result);
+    } catch (const exception& e) {
+        cerr << "load generator failed: "s << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
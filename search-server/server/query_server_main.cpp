@@ -0,0 +1,161 @@
+// Сервер запросов поверх SearchServer, протокол описан в query_server.h.
+//
+// Сборка: цель search_query_server в CMakeLists.txt.
+//
+// Запуск:
+//   ./search_query_server --unix /tmp/search.sock --synthetic 100000 --threads 4
+//   ./search_query_server --port 7700 --documents documents.txt --stop-words "and in at"
+// SIGINT и SIGTERM останавливают сервер.
+
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "../benchmark/corpus_generator.h"
+#include "../durable_search_server.h"
+#include "../query_server.h"
+#include "../search_server.h"
+
+using namespace std;
+
+namespace {
+
+struct ServerConfig {
+    QueryServerOptions options;
+    string stop_words;
+    // Источник документов: файл (документ на строку), каталог DurableSearchServer
+    // или синтетический корпус
+    string documents_path;
+    string data_directory;
+    size_t synthetic_documents = 0;
+    uint64_t seed = 42;
+    size_t vocabulary_size = 50000;
+};
+
+ServerConfig ParseArguments(int argc, char** argv) {
+    ServerConfig config;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw invalid_argument("missing value for "s + arg);
+        }
+        const string value = argv[++i];
+        if (arg == "--unix"s) {
+            config.options.unix_socket_path = value;
+        } else if (arg == "--port"s) {
+            config.options.tcp_port = static_cast<uint16_t>(stoul(value));
+        } else if (arg == "--threads"s) {
+            config.options.threads = stoull(value);
+        } else if (arg == "--max-batch"s) {
+            config.options.max_batch_size = stoull(value);
+        } else if (arg == "--stop-words"s) {
+            config.stop_words = value;
+        } else if (arg == "--documents"s) {
+            config.documents_path = value;
+        } else if (arg == "--data"s) {
+            config.data_directory = value;
+        } else if (arg == "--synthetic"s) {
+            config.synthetic_documents = stoull(value);
+        } else if (arg == "--seed"s) {
+            config.seed = stoull(value);
+        } else if (arg == "--vocabulary"s) {
+            config.vocabulary_size = stoull(value);
+        } else {
+            throw invalid_argument("unknown option "s + arg);
+        }
+    }
+    return config;
+}
+
+unique_ptr<SearchServer> LoadSearchServer(const ServerConfig& config) {
+    if (config.synthetic_documents > 0) {
+        CorpusGenerator::Options options;
+        options.seed = config.seed;
+        options.vocabulary_size = config.vocabulary_size;
+        CorpusGenerator generator(options);
+        auto server = make_unique<SearchServer>(generator.GetStopWords());
+        for (size_t i = 0; i < config.synthetic_documents; ++i) {
+            const string document = generator.GenerateDocument();
+            const vector<int> ratings = generator.GenerateRatings();
+            server->AddDocument(static_cast<int>(i), document, generator.GenerateStatus(), ratings);
+        }
+        return server;
+    }
+
+    auto server = make_unique<SearchServer>(config.stop_words);
+    if (!config.data_directory.empty()) {
+        // Восстановление из снимка и журнала; обёртка нужна только для него
+        const DurableSearchServer durable_server(*server, config.data_directory);
+    } else if (!config.documents_path.empty()) {
+        ifstream input(config.documents_path);
+        if (!input) {
+            throw invalid_argument("cannot open "s + config.documents_path);
+        }
+        int document_id = 0;
+        for (string line; getline(input, line);) {
+            server->AddDocument(++document_id, line, DocumentStatus::ACTUAL, {});
+        }
+    } else {
+        throw invalid_argument("one of --documents, --data or --synthetic is required"s);
+    }
+    return server;
+}
+
+atomic<QueryServer*> running_server{nullptr};
+
+void HandleSignal(int) {
+    if (QueryServer* server = running_server.load()) {
+        server->Stop();
+    }
+}
+
+// SIGINT и SIGTERM останавливают сервер, пока жив этот объект. Объявляется
+// после сервера и разрушается раньше него, в том числе при исключении из Run
+class StopOnSignal {
+public:
+    explicit StopOnSignal(QueryServer& server) {
+        running_server = &server;
+        signal(SIGINT, HandleSignal);
+        signal(SIGTERM, HandleSignal);
+    }
+
+    StopOnSignal(const StopOnSignal&) = delete;
+    StopOnSignal& operator=(const StopOnSignal&) = delete;
+
+    ~StopOnSignal() {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        running_server = nullptr;
+    }
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    try {
+        const ServerConfig config = ParseArguments(argc, argv);
+        const auto search_server = LoadSearchServer(config);
+        search_server->WaitForMerges();
+        QueryServer query_server(*search_server, config.options);
+        const StopOnSignal stop_on_signal(query_server);
+
+        cerr << "serving "s << search_server->GetDocumentCount() << " documents on "s
+             << (config.options.unix_socket_path.empty() ? "127.0.0.1:"s + to_string(query_server.GetPort())
+                                                         : config.options.unix_socket_path)
+             << endl;
+        query_server.Run();
+
+        const QueryServerStats& stats = query_server.GetStats();
+        cerr << "served "s << stats.requests << " requests in "s << stats.batches << " batches over "s
+             << stats.connections << " connections"s << endl;
+    } catch (const exception& e) {
+        cerr << "query server failed: "s << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,37 @@
+#include "simd.h"
+
+#include <algorithm>
+
+using namespace std;
+
+SimdLevel DetectSimdLevel() {
+    static const SimdLevel level = [] {
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return SimdLevel::AVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return SimdLevel::SSE2;
+        }
+#endif
+        return SimdLevel::SCALAR;
+    }();
+    return level;
+}
+
+SimdLevel ClampSimdLevel(SimdLevel requested) {
+    return min(requested, DetectSimdLevel());
+}
+
+const char* ToString(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SCALAR:
+            return "scalar";
+        case SimdLevel::SSE2:
+            return "sse2";
+        case SimdLevel::AVX2:
+            return "avx2";
+    }
+    return "unknown";
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// Набор векторных инструкций, которые можно использовать на текущем процессоре.
+// Уровни упорядочены: каждый следующий включает возможности предыдущего.
+enum class SimdLevel {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+// Определяется один раз при первом вызове
+SimdLevel DetectSimdLevel();
+
+// Запрошенный уровень, но не выше поддерживаемого процессором
+SimdLevel ClampSimdLevel(SimdLevel requested);
+
+const char* ToString(SimdLevel level);
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "memory_usage.h"
+
+using namespace std;
+
+// Минимальная совершенная хеш-функция (hash-and-displace) над стоп-словами:
+// каждое слово получает собственный слот, поэтому проверка слова стоит одного
+// хеширования и одного сравнения строк. Построение общее для таблиц,
+// собираемых во время выполнения и во время компиляции.
+namespace perfect_hash {
+
+inline constexpr uint32_t MAX_DISPLACEMENT = 1u << 24;
+
+// FNV-1a с финальным перемешиванием, чтобы младшие биты зависели от всего слова
+constexpr uint64_t HashWord(string_view word) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const char c : word) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    hash ^= hash >> 32;
+    return hash;
+}
+
+constexpr size_t BucketCount(size_t word_count) {
+    return word_count / 2 + 1;
+}
+
+// splitmix64 от хеша слова и смещения корзины
+constexpr size_t SlotOf(uint64_t hash, uint32_t displacement, size_t slot_count) {
+    uint64_t x = hash + (static_cast<uint64_t>(displacement) + 1) * 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return static_cast<size_t>(x % slot_count);
+}
+
+// Words — уникальные слова, Scratch — контейнеры размера words.size()
+// (std::array во время компиляции, std::vector во время выполнения).
+// В displacements записывается смещение каждой корзины, в slot_words —
+// индекс слова, занявшего слот.
+template <typename Words, typename Displacements, typename Scratch>
+constexpr void Build(const Words& words, Displacements& displacements, Scratch& slot_words,
+                     Scratch& hashes, Scratch& order) {
+    const size_t word_count = words.size();
+    const size_t bucket_count = displacements.size();
+    // Пока смещения не выбраны, displacements хранит размеры корзин
+    for (size_t bucket = 0; bucket < bucket_count; ++bucket) {
+        displacements[bucket] = 0;
+    }
+    for (size_t i = 0; i < word_count; ++i) {
+        hashes[i] = HashWord(words[i]);
+        slot_words[i] = word_count;
+        ++displacements[hashes[i] % bucket_count];
+    }
+
+    // Слова упорядочиваются по корзинам, большие корзины идут первыми,
+    // пока свободных слотов много
+    const auto goes_before = [&](size_t lhs, size_t rhs) {
+        const size_t lhs_bucket = hashes[lhs] % bucket_count;
+        const size_t rhs_bucket = hashes[rhs] % bucket_count;
+        if (displacements[lhs_bucket] != displacements[rhs_bucket]) {
+            return displacements[lhs_bucket] > displacements[rhs_bucket];
+        }
+        return lhs_bucket < rhs_bucket;
+    };
+    for (size_t i = 0; i < word_count; ++i) {
+        size_t pos = i;
+        for (; pos > 0 && goes_before(i, order[pos - 1]); --pos) {
+            order[pos] = order[pos - 1];
+        }
+        order[pos] = i;
+    }
+
+    for (size_t first = 0; first < word_count;) {
+        const size_t bucket = hashes[order[first]] % bucket_count;
+        size_t last = first + 1;
+        while (last < word_count && hashes[order[last]] % bucket_count == bucket) {
+            ++last;
+        }
+
+        // Слова с одинаковым хешем не разводятся никаким смещением: без этой
+        // проверки перебор дошёл бы до MAX_DISPLACEMENT, а во время компиляции
+        // упёрся бы в лимит вычислений
+        for (size_t m = first + 1; m < last; ++m) {
+            for (size_t prev = first; prev < m; ++prev) {
+                if (hashes[order[prev]] == hashes[order[m]]) {
+                    throw invalid_argument(words[order[prev]] == words[order[m]] ? "duplicate stop word"
+                                                                                 : "stop word hash collision");
+                }
+            }
+        }
+
+        bool placed = false;
+        for (uint32_t displacement = 0; !placed && displacement < MAX_DISPLACEMENT; ++displacement) {
+            placed = true;
+            for (size_t m = first; placed && m < last; ++m) {
+                const size_t slot = SlotOf(hashes[order[m]], displacement, word_count);
+                placed = slot_words[slot] == word_count;
+                for (size_t prev = first; placed && prev < m; ++prev) {
+                    placed = SlotOf(hashes[order[prev]], displacement, word_count) != slot;
+                }
+            }
+            if (placed) {
+                displacements[bucket] = displacement;
+                for (size_t m = first; m < last; ++m) {
+                    slot_words[SlotOf(hashes[order[m]], displacement, word_count)] = order[m];
+                }
+            }
+        }
+        if (!placed) {
+            throw invalid_argument("cannot place stop words");
+        }
+        first = last;
+    }
+}
+
+constexpr bool IsValidStopWord(string_view word) {
+    if (word.empty()) {
+        return false;
+    }
+    for (const char c : word) {
+        if (c >= '\0' && c < ' ') {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace perfect_hash
+
+// Таблица стоп-слов, построенная во время компиляции:
+//     constexpr auto stop_words = MakeStaticStopWords({"and"sv, "in"sv, "at"sv});
+//     SearchServer server(stop_words);
+// Слова должны быть уникальными, непустыми и без спецсимволов,
+// иначе программа не скомпилируется.
+template <size_t N>
+class StaticStopWords {
+public:
+    static constexpr size_t BUCKET_COUNT = perfect_hash::BucketCount(N);
+
+    constexpr explicit StaticStopWords(const array<string_view, N>& words) {
+        array<uint64_t, N> slot_words{};
+        array<uint64_t, N> hashes{};
+        array<uint64_t, N> order{};
+        for (const string_view word : words) {
+            if (!perfect_hash::IsValidStopWord(word)) {
+                throw invalid_argument("stop word got unacceptable symbols");
+            }
+        }
+        perfect_hash::Build(words, displacements_, slot_words, hashes, order);
+        for (size_t slot = 0; slot < N; ++slot) {
+            slots_[slot] = words[slot_words[slot]];
+        }
+    }
+
+    constexpr bool Contains(string_view word) const {
+        if constexpr (N == 0) {
+            return false;
+        } else {
+            const uint64_t hash = perfect_hash::HashWord(word);
+            const uint32_t displacement = displacements_[hash % BUCKET_COUNT];
+            return slots_[perfect_hash::SlotOf(hash, displacement, N)] == word;
+        }
+    }
+
+    constexpr const array<string_view, N>& GetSlots() const {
+        return slots_;
+    }
+
+    constexpr const array<uint32_t, BUCKET_COUNT>& GetDisplacements() const {
+        return displacements_;
+    }
+
+private:
+    array<string_view, N> slots_{};
+    array<uint32_t, BUCKET_COUNT> displacements_{};
+};
+
+template <size_t N>
+constexpr StaticStopWords<N> MakeStaticStopWords(const string_view (&words)[N]) {
+    array<string_view, N> word_array{};
+    for (size_t i = 0; i < N; ++i) {
+        word_array[i] = words[i];
+    }
+    return StaticStopWords<N>(word_array);
+}
+
+// Стоп-слова поискового сервера. Слова хранятся одним буфером в порядке слотов.
+class StopWords {
+public:
+    StopWords() = default;
+
+    // Слова должны быть непустыми и без спецсимволов, повторы отбрасываются
+    template <typename StringContainer>
+    explicit StopWords(const StringContainer& words) {
+        vector<string_view> unique_words(begin(words), end(words));
+        sort(unique_words.begin(), unique_words.end());
+        unique_words.erase(unique(unique_words.begin(), unique_words.end()), unique_words.end());
+        displacements_.assign(perfect_hash::BucketCount(unique_words.size()), 0);
+        vector<uint64_t> slot_words(unique_words.size());
+        vector<uint64_t> hashes(unique_words.size());
+        vector<uint64_t> order(unique_words.size());
+        perfect_hash::Build(unique_words, displacements_, slot_words, hashes, order);
+        for (const uint64_t word_index : slot_words) {
+            AppendSlot(unique_words[word_index]);
+        }
+    }
+
+    // Таблица уже построена компилятором, остаётся скопировать слова
+    template <size_t N>
+    explicit StopWords(const StaticStopWords<N>& static_stop_words)
+        : displacements_(static_stop_words.GetDisplacements().begin(),
+                         static_stop_words.GetDisplacements().end()) {
+        for (const string_view word : static_stop_words.GetSlots()) {
+            AppendSlot(word);
+        }
+    }
+
+    bool Contains(string_view word) const {
+        const size_t slot_count = size();
+        if (slot_count == 0) {
+            return false;
+        }
+        const uint64_t hash = perfect_hash::HashWord(word);
+        const uint32_t displacement = displacements_[hash % displacements_.size()];
+        const size_t slot = perfect_hash::SlotOf(hash, displacement, slot_count);
+        return string_view(storage_).substr(offsets_[slot], offsets_[slot + 1] - offsets_[slot]) == word;
+    }
+
+    size_t size() const {
+        return offsets_.size() - 1;
+    }
+
+    size_t GetMemoryUsage() const {
+        return memory_usage::StringHeap(storage_) + memory_usage::VectorHeap(offsets_)
+            + memory_usage::VectorHeap(displacements_);
+    }
+
+private:
+    string storage_;
+    vector<uint32_t> offsets_ = {0};
+    vector<uint32_t> displacements_;
+
+    void AppendSlot(string_view word) {
+        storage_.append(word);
+        offsets_.push_back(static_cast<uint32_t>(storage_.size()));
+    }
+};
@@ -1,36 +1,153 @@
 #include "string_processing.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <stdexcept>
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SEARCH_SERVER_X86_SIMD
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
-vector<string> SplitIntoWords(const string& text) {
-    vector<string> words;
-    string word;
-    for (const char c : text) {
-        if (c == ' ') {
-            if (!word.empty()) {
-                words.push_back(word);
-                word.clear();
-            }
+namespace {
+
+bool IsSpecialCharacter(char c) {
+    return c >= '\0' && c < ' ';
+}
+
+// Собирает слова по позициям пробелов и спецсимволов в порядке возрастания
+class TokenCollector {
+public:
+    explicit TokenCollector(string_view text) : text_(text) {
+        // Средняя длина слова с пробелом в тексте на естественном языке около 6 байт
+        result_.words.reserve(text.size() / 6 + 1);
+    }
+
+    void Separator(size_t pos) {
+        if (pos > word_begin_) {
+            Emit(pos);
+        }
+        word_begin_ = pos + 1;
+    }
+
+    void SpecialCharacter() {
+        word_is_invalid_ = true;
+    }
+
+    TokenizedText Finish() {
+        if (text_.size() > word_begin_) {
+            Emit(text_.size());
+        }
+        return move(result_);
+    }
+
+private:
+    string_view text_;
+    TokenizedText result_;
+    size_t word_begin_ = 0;
+    bool word_is_invalid_ = false;
+
+    void Emit(size_t word_end) {
+        if (word_is_invalid_ && result_.first_invalid_word == NO_INVALID_WORD) {
+            result_.first_invalid_word = result_.words.size();
+        }
+        word_is_invalid_ = false;
+        result_.words.push_back(text_.substr(word_begin_, word_end - word_begin_));
+    }
+};
+
+void TokenizeScalar(string_view text, size_t from, TokenCollector& collector) {
+    for (size_t pos = from; pos < text.size(); ++pos) {
+        if (text[pos] == ' ') {
+            collector.Separator(pos);
+        } else if (IsSpecialCharacter(text[pos])) {
+            collector.SpecialCharacter();
+        }
+    }
+}
+
+#ifdef SEARCH_SERVER_X86_SIMD
+
+// Биты separators и specials взаимоисключающие, обходим их объединение по возрастанию
+void ProcessMasks(size_t base, uint32_t separators, uint32_t specials, TokenCollector& collector) {
+    uint32_t pending = separators | specials;
+    while (pending != 0) {
+        const int offset = __builtin_ctz(pending);
+        if ((separators >> offset) & 1u) {
+            collector.Separator(base + offset);
         } else {
-            word += c;
+            collector.SpecialCharacter();
         }
+        pending &= pending - 1;
     }
-    if (!word.empty()) {
-        words.push_back(word);
+}
+
+__attribute__((target("sse2")))
+void TokenizeSse2(string_view text, TokenCollector& collector) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i max_special = _mm_set1_epi8(' ' - 1);
+    size_t pos = 0;
+    for (; pos + 16 <= text.size(); pos += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos));
+        // Беззнаковое сравнение block <= 0x1F через min
+        const __m128i special = _mm_cmpeq_epi8(_mm_min_epu8(block, max_special), block);
+        const auto separators = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, space)));
+        const auto specials = static_cast<uint32_t>(_mm_movemask_epi8(special));
+        ProcessMasks(pos, separators, specials, collector);
+    }
+    TokenizeScalar(text, pos, collector);
+}
+
+__attribute__((target("avx2")))
+void TokenizeAvx2(string_view text, TokenCollector& collector) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i max_special = _mm256_set1_epi8(' ' - 1);
+    size_t pos = 0;
+    for (; pos + 32 <= text.size(); pos += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + pos));
+        const __m256i special = _mm256_cmpeq_epi8(_mm256_min_epu8(block, max_special), block);
+        const auto separators = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, space)));
+        const auto specials = static_cast<uint32_t>(_mm256_movemask_epi8(special));
+        ProcessMasks(pos, separators, specials, collector);
     }
+    TokenizeScalar(text, pos, collector);
+}
+
+#endif
 
-    return words;
+}  // namespace
+
+TokenizedText TokenizeText(string_view text) {
+    return TokenizeText(text, DetectSimdLevel());
 }
 
+TokenizedText TokenizeText(string_view text, SimdLevel level) {
+    TokenCollector collector(text);
+    switch (ClampSimdLevel(level)) {
+#ifdef SEARCH_SERVER_X86_SIMD
+        case SimdLevel::AVX2:
+            TokenizeAvx2(text, collector);
+            break;
+        case SimdLevel::SSE2:
+            TokenizeSse2(text, collector);
+            break;
+#endif
+        default:
+            TokenizeScalar(text, 0, collector);
+            break;
+    }
+    return collector.Finish();
+}
 
+vector<string> SplitIntoWords(const string& text) {
+    const auto tokens = TokenizeText(text);
+    return {tokens.words.begin(), tokens.words.end()};
+}
 
-bool IsValidWord(const std::string& word) {
+bool IsValidWord(string_view word) {
     // A valid word must not contain special characters
-    return none_of(word.begin(), word.end(), [](char c) {
-        return c >= '\0' && c < ' ';
-    });
-}
\ No newline at end of file
+    return none_of(word.begin(), word.end(), IsSpecialCharacter);
+}
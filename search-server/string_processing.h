@@ -1,18 +1,37 @@
 #pragma once
 
+#include <functional>
+#include <limits>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <set>
 #include <stdexcept>
 
+#include "simd.h"
+
 using namespace std;
 
+inline constexpr size_t NO_INVALID_WORD = numeric_limits<size_t>::max();
+
+struct TokenizedText {
+    // Слова указывают в исходный текст и живут, пока жив он
+    std::vector<std::string_view> words;
+    // Индекс первого слова со спецсимволом (байт < 0x20) или NO_INVALID_WORD
+    size_t first_invalid_word = NO_INVALID_WORD;
+};
+
+// Разбивает текст по пробелам и за тот же проход ищет спецсимволы.
+// Блоки по 16/32 байта обрабатываются SSE2/AVX2, если процессор их поддерживает.
+TokenizedText TokenizeText(std::string_view text);
+TokenizedText TokenizeText(std::string_view text, SimdLevel level);
+
 std::vector<std::string> SplitIntoWords(const std::string& text);
-bool IsValidWord(const std::string& word);
+bool IsValidWord(std::string_view word);
 
 template <typename StringContainer>
-std::set<std::string> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
-    set<string> non_empty_strings;
+std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
+    set<string, less<>> non_empty_strings;
     for (const string& str : strings) {
         if (!IsValidWord(str)) {
             throw invalid_argument("stop word '" + str + "' got unacceptable symbols"s);
@@ -22,4 +41,4 @@ std::set<std::string> MakeUniqueNonEmptyStrings(const StringContainer& strings)
         }
     }
     return non_empty_strings;
-}
\ No newline at end of file
+}
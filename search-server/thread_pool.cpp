@@ -0,0 +1,107 @@
+#include "thread_pool.h"
+
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+// Пул и номер потока, выполняющего код; у внешних потоков пула нет
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    if (thread_count == 0) {
+        throw invalid_argument("thread pool needs at least one thread"s);
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        queues_.push_back(make_unique<WorkerQueue>());
+    }
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.emplace_back([this, i] {
+            WorkerLoop(i);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_condition_.notify_all();
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::Submit(function<void()> task) {
+    const size_t index = current_pool == this ? current_worker : next_queue_++ % queues_.size();
+    {
+        lock_guard lock(queues_[index]->queue_mutex);
+        queues_[index]->tasks.push_back(move(task));
+    }
+    ++pending_;
+    // Захват мьютекса не даёт уведомлению проскочить между проверкой условия и засыпанием
+    {
+        lock_guard lock(sleep_mutex_);
+    }
+    wake_condition_.notify_one();
+}
+
+ThreadPoolStats ThreadPool::GetStats() const {
+    return {executed_.load(), stolen_.load()};
+}
+
+bool ThreadPool::TakeTask(size_t worker_index, function<void()>& task) {
+    {
+        WorkerQueue& own = *queues_[worker_index];
+        lock_guard lock(own.queue_mutex);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+            --pending_;
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < queues_.size(); ++offset) {
+        WorkerQueue& victim = *queues_[(worker_index + offset) % queues_.size()];
+        lock_guard lock(victim.queue_mutex);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --pending_;
+            ++stolen_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(size_t worker_index) {
+    current_pool = this;
+    current_worker = worker_index;
+    while (true) {
+        function<void()> task;
+        if (TakeTask(worker_index, task)) {
+            try {
+                task();
+            } catch (const exception& e) {
+                cerr << "thread pool task failed: "s << e.what() << endl;
+            }
+            ++executed_;
+            continue;
+        }
+        unique_lock lock(sleep_mutex_);
+        wake_condition_.wait(lock, [this] {
+            return pending_ > 0 || stopping_;
+        });
+        if (stopping_ && pending_ <= 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct ThreadPoolStats {
+    uint64_t executed = 0;
+    // Задачи, выполненные не тем потоком, в чью очередь они попали
+    uint64_t stolen = 0;
+};
+
+// Пул с фиксированным числом потоков и очередью на каждый поток. Поток берёт
+// задачи с конца своей очереди, а опустев, крадёт с начала чужих. Задача,
+// поставленная из потока пула, попадает в его же очередь, внешние задачи
+// раскладываются по очередям по кругу.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    // Выполняет уже поставленные задачи и останавливает потоки
+    ~ThreadPool();
+
+    // Исключение из задачи пишется в cerr и дальше не идёт
+    void Submit(function<void()> task);
+
+    size_t GetThreadCount() const {
+        return workers_.size();
+    }
+
+    ThreadPoolStats GetStats() const;
+
+private:
+    struct WorkerQueue {
+        mutex queue_mutex;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<WorkerQueue>> queues_;
+    atomic<size_t> next_queue_{0};
+    // Поставленные, но ещё не взятые задачи; кратковременно бывает
+    // отрицательным, если задачу взяли раньше, чем её учли
+    atomic<int64_t> pending_{0};
+    mutex sleep_mutex_;
+    condition_variable wake_condition_;
+    bool stopping_ = false;
+    atomic<uint64_t> executed_{0};
+    atomic<uint64_t> stolen_{0};
+    vector<thread> workers_;
+
+    bool TakeTask(size_t worker_index, function<void()>& task);
+    void WorkerLoop(size_t worker_index);
+};
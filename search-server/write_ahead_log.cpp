@@ -0,0 +1,364 @@
+#include "write_ahead_log.h"
+
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "binary_io.h"
+
+using namespace std;
+
+namespace {
+
+constexpr string_view WAL_MAGIC = "SSWAL001"sv;
+// Длина содержимого и его CRC-32
+constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+[[noreturn]] void ThrowSystemError(const string& what, const string& path) {
+    throw system_error(errno, generic_category(), what + " "s + path);
+}
+
+void AppendRecord(string& output, const WalRecord& record) {
+    string payload;
+    binary_io::AppendInteger(payload, record.sequence);
+    binary_io::AppendInteger(payload, static_cast<uint8_t>(record.type));
+    binary_io::AppendInteger(payload, static_cast<int32_t>(record.document_id));
+    if (record.type == WalRecordType::ADD_DOCUMENT) {
+        binary_io::AppendInteger(payload, static_cast<uint8_t>(record.status));
+        binary_io::AppendInteger(payload, static_cast<uint32_t>(record.ratings.size()));
+        for (const int rating : record.ratings) {
+            binary_io::AppendInteger(payload, static_cast<int32_t>(rating));
+        }
+        binary_io::AppendString(payload, record.document);
+    }
+    binary_io::AppendInteger(output, static_cast<uint32_t>(payload.size()));
+    binary_io::AppendInteger(output, binary_io::Crc32(payload));
+    output += payload;
+}
+
+WalRecord ParseRecord(string_view payload) {
+    binary_io::Reader reader(payload);
+    WalRecord record;
+    record.sequence = reader.ReadInteger<uint64_t>();
+    record.type = static_cast<WalRecordType>(reader.ReadInteger<uint8_t>());
+    record.document_id = reader.ReadInteger<int32_t>();
+    if (record.type == WalRecordType::ADD_DOCUMENT) {
+        record.status = static_cast<DocumentStatus>(reader.ReadInteger<uint8_t>());
+        record.ratings.resize(reader.ReadInteger<uint32_t>());
+        for (int& rating : record.ratings) {
+            rating = reader.ReadInteger<int32_t>();
+        }
+        record.document = string(reader.ReadString());
+    } else if (record.type != WalRecordType::REMOVE_DOCUMENT) {
+        throw invalid_argument("unknown write-ahead log record type"s);
+    }
+    if (!reader.AtEnd()) {
+        throw invalid_argument("write-ahead log record has trailing data"s);
+    }
+    return record;
+}
+
+void TruncateFile(const string& path, size_t size) {
+    const int file_descriptor = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (file_descriptor < 0) {
+        ThrowSystemError("cannot open write-ahead log"s, path);
+    }
+    const bool ok = ftruncate(file_descriptor, static_cast<off_t>(size)) == 0 && fsync(file_descriptor) == 0;
+    const int error = errno;
+    close(file_descriptor);
+    if (!ok) {
+        errno = error;
+        ThrowSystemError("cannot truncate write-ahead log"s, path);
+    }
+}
+
+}  // namespace
+
+WriteAheadLog::WriteAheadLog(const string& path, const WalOptions& options)
+    : path_(path), options_(options) {
+    file_descriptor_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (file_descriptor_ < 0) {
+        ThrowSystemError("cannot open write-ahead log"s, path_);
+    }
+    struct stat file_stat;
+    if (fstat(file_descriptor_, &file_stat) != 0) {
+        const int error = errno;
+        close(file_descriptor_);
+        errno = error;
+        ThrowSystemError("cannot stat write-ahead log"s, path_);
+    }
+    file_size_ = static_cast<uint64_t>(file_stat.st_size);
+    if (file_size_ == 0) {
+        string header(WAL_MAGIC);
+        WriteAll(header);
+        Sync();
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    {
+        lock_guard lock(log_mutex_);
+        stop_flushing_ = true;
+    }
+    flush_condition_.notify_all();
+    if (flush_thread_.joinable()) {
+        flush_thread_.join();
+    }
+    try {
+        Commit();
+    } catch (const exception& e) {
+        cerr << "write-ahead log commit failed: "s << e.what() << endl;
+    }
+    close(file_descriptor_);
+}
+
+void WriteAheadLog::Append(const WalRecord& record) {
+    lock_guard lock(log_mutex_);
+    RethrowFlushError();
+    const auto now = chrono::steady_clock::now();
+    const bool starts_group = pending_records_ == 0;
+    if (starts_group) {
+        oldest_pending_ = now;
+    }
+    const size_t record_start = pending_.size();
+    AppendRecord(pending_, record);
+    ++pending_records_;
+    ++stats_.records;
+    if (options_.sync_policy == WalSyncPolicy::EVERY_RECORD
+        || pending_records_ >= options_.group_commit_records
+        || pending_.size() >= options_.group_commit_bytes
+        || now - oldest_pending_ >= options_.group_commit_delay) {
+        const uint64_t group_start = file_size_;
+        try {
+            CommitPending();
+        } catch (...) {
+            DropFailedRecord(group_start + record_start, pending_.size() + (file_size_ - group_start) - record_start);
+            throw;
+        }
+        return;
+    }
+    if (starts_group) {
+        if (!flush_thread_.joinable()) {
+            flush_thread_ = thread([this] {
+                FlushLoop();
+            });
+        }
+        flush_condition_.notify_all();
+    }
+}
+
+void WriteAheadLog::Commit() {
+    lock_guard lock(log_mutex_);
+    RethrowFlushError();
+    CommitPending();
+}
+
+WalStats WriteAheadLog::GetStats() const {
+    lock_guard lock(log_mutex_);
+    return stats_;
+}
+
+void WriteAheadLog::RethrowFlushError() {
+    if (flush_error_) {
+        // Ошибка передана вызывающему, фоновый поток снова следит за сроком
+        flush_condition_.notify_all();
+        rethrow_exception(exchange(flush_error_, nullptr));
+    }
+}
+
+void WriteAheadLog::FlushLoop() {
+    unique_lock lock(log_mutex_);
+    while (true) {
+        flush_condition_.wait(lock, [this] {
+            return stop_flushing_ || pending_records_ > 0;
+        });
+        if (stop_flushing_) {
+            return;
+        }
+        // Группу могут записать раньше срока (Append по размеру, Commit) и начать новую
+        const auto deadline = oldest_pending_ + options_.group_commit_delay;
+        const bool expired = !flush_condition_.wait_until(lock, deadline, [this, deadline] {
+            return stop_flushing_ || pending_records_ == 0 || oldest_pending_ + options_.group_commit_delay != deadline;
+        });
+        if (expired) {
+            try {
+                CommitPending();
+            } catch (...) {
+                flush_error_ = current_exception();
+                // Группа остаётся в памяти, пока ошибку не заберёт Append или Commit
+                flush_condition_.wait(lock, [this] {
+                    return stop_flushing_ || !flush_error_;
+                });
+            }
+        }
+    }
+}
+
+void WriteAheadLog::CommitPending() {
+    if (pending_records_ == 0) {
+        return;
+    }
+    const size_t group_size = pending_.size();
+    try {
+        WriteAll(pending_);
+    } catch (...) {
+        stats_.bytes_written += group_size - pending_.size();
+        throw;
+    }
+    stats_.bytes_written += group_size;
+    pending_records_ = 0;
+    ++stats_.commits;
+    if (options_.sync_policy != WalSyncPolicy::NONE) {
+        Sync();
+    }
+}
+
+// Append, бросивший исключение, не оставляет свою запись в журнале: она
+// последняя в группе, поэтому убирается из хвоста буфера, а уже записанная
+// часть отрезается от файла. Более ранние записи группы остаются на повтор.
+void WriteAheadLog::DropFailedRecord(uint64_t record_offset, size_t record_size) {
+    --stats_.records;
+    if (file_size_ <= record_offset) {
+        pending_.resize(pending_.size() - record_size);
+        pending_records_ = pending_.empty() ? 0 : pending_records_ - 1;
+        return;
+    }
+    pending_.clear();
+    pending_records_ = 0;
+    if (ftruncate(file_descriptor_, static_cast<off_t>(record_offset)) != 0) {
+        ThrowSystemError("cannot truncate write-ahead log"s, path_);
+    }
+    file_size_ = record_offset;
+}
+
+void WriteAheadLog::Reset() {
+    lock_guard lock(log_mutex_);
+    pending_.clear();
+    pending_records_ = 0;
+    if (ftruncate(file_descriptor_, static_cast<off_t>(WAL_MAGIC.size())) != 0) {
+        ThrowSystemError("cannot truncate write-ahead log"s, path_);
+    }
+    file_size_ = WAL_MAGIC.size();
+    Sync();
+}
+
+// Записанное сразу убирается из data: если write() записал часть и упал
+// (например, ENOSPC), повтор допишет только остаток, а не продублирует
+// начало группы — иначе посреди журнала окажется разорванная запись
+void WriteAheadLog::WriteAll(string& data) {
+    while (!data.empty()) {
+        const ssize_t written = write(file_descriptor_, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("cannot write write-ahead log"s, path_);
+        }
+        data.erase(0, static_cast<size_t>(written));
+        file_size_ += static_cast<uint64_t>(written);
+    }
+}
+
+void WriteAheadLog::Sync() {
+    if (fdatasync(file_descriptor_) != 0) {
+        ThrowSystemError("cannot sync write-ahead log"s, path_);
+    }
+    ++stats_.syncs;
+}
+
+WalReplayStats ReplayWriteAheadLog(const string& path, const function<void(const WalRecord&)>& apply) {
+    WalReplayStats stats;
+    ifstream input(path, ios::binary);
+    if (!input) {
+        // Журнала ещё нет
+        const WriteAheadLog created_log(path);
+        return stats;
+    }
+    const string data{istreambuf_iterator<char>(input), istreambuf_iterator<char>()};
+    input.close();
+    if (data.size() < WAL_MAGIC.size()) {
+        // Падение во время создания файла
+        stats.truncated_bytes = data.size();
+        TruncateFile(path, 0);
+        const WriteAheadLog created_log(path);
+        return stats;
+    }
+    if (string_view(data).substr(0, WAL_MAGIC.size()) != WAL_MAGIC) {
+        throw invalid_argument("not a write-ahead log: "s + path);
+    }
+
+    size_t position = WAL_MAGIC.size();
+    while (position < data.size()) {
+        if (data.size() - position < RECORD_HEADER_SIZE) {
+            break;
+        }
+        binary_io::Reader header(string_view(data).substr(position, RECORD_HEADER_SIZE));
+        const auto payload_size = header.ReadInteger<uint32_t>();
+        const auto checksum = header.ReadInteger<uint32_t>();
+        if (payload_size > data.size() - position - RECORD_HEADER_SIZE) {
+            break;
+        }
+        const string_view payload = string_view(data).substr(position + RECORD_HEADER_SIZE, payload_size);
+        if (binary_io::Crc32(payload) != checksum) {
+            break;
+        }
+        WalRecord record;
+        try {
+            record = ParseRecord(payload);
+        } catch (const exception&) {
+            break;
+        }
+        apply(record);
+        ++stats.records;
+        stats.last_sequence = record.sequence;
+        position += RECORD_HEADER_SIZE + payload_size;
+    }
+    if (position < data.size()) {
+        stats.truncated_bytes = data.size() - position;
+        TruncateFile(path, position);
+    }
+    return stats;
+}
+
+void WriteFileAtomically(const string& path, string_view data) {
+    const string temporary_path = path + ".tmp"s;
+    const int file_descriptor = open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file_descriptor < 0) {
+        ThrowSystemError("cannot create"s, temporary_path);
+    }
+    bool ok = true;
+    while (ok && !data.empty()) {
+        const ssize_t written = write(file_descriptor, data.data(), data.size());
+        if (written >= 0) {
+            data.remove_prefix(static_cast<size_t>(written));
+        } else {
+            ok = errno == EINTR;
+        }
+    }
+    ok = ok && fsync(file_descriptor) == 0;
+    const int error = errno;
+    close(file_descriptor);
+    if (!ok) {
+        errno = error;
+        ThrowSystemError("cannot write"s, temporary_path);
+    }
+    if (rename(temporary_path.c_str(), path.c_str()) != 0) {
+        ThrowSystemError("cannot rename"s, temporary_path);
+    }
+    // Переименование становится долговечным только после fsync каталога
+    const auto separator = path.rfind('/');
+    const string directory = separator == string::npos ? "."s : path.substr(0, max<size_t>(separator, 1));
+    const int directory_descriptor = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_descriptor >= 0) {
+        fsync(directory_descriptor);
+        close(directory_descriptor);
+    }
+}
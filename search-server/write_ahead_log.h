@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "document.h"
+
+using namespace std;
+
+// Когда журнал вызывает fsync
+enum class WalSyncPolicy {
+    // Только write(): записи переживают падение процесса, но не падение ОС
+    NONE,
+    // Один fsync на групповую запись
+    GROUP_COMMIT,
+    // Каждая запись фиксируется отдельно со своим fsync
+    EVERY_RECORD,
+};
+
+struct WalOptions {
+    WalSyncPolicy sync_policy = WalSyncPolicy::GROUP_COMMIT;
+    // Группа записывается, как только в ней столько записей или байт,
+    // либо когда самой старой записи в группе больше group_commit_delay:
+    // по сроку группу записывает фоновый поток, даже если новых записей нет
+    size_t group_commit_records = 64;
+    size_t group_commit_bytes = 1 << 20;
+    chrono::microseconds group_commit_delay{2000};
+};
+
+enum class WalRecordType : uint8_t {
+    ADD_DOCUMENT = 1,
+    REMOVE_DOCUMENT = 2,
+};
+
+struct WalRecord {
+    uint64_t sequence = 0;
+    WalRecordType type = WalRecordType::ADD_DOCUMENT;
+    int document_id = 0;
+    // Для REMOVE_DOCUMENT не используются
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    vector<int> ratings;
+    string document;
+};
+
+struct WalStats {
+    uint64_t records = 0;
+    uint64_t commits = 0;
+    uint64_t syncs = 0;
+    // Байты, записанные в файл журнала, вместе с заголовками записей
+    uint64_t bytes_written = 0;
+};
+
+// Журнал предзаписи: файл только дописывается, каждая запись хранит длину
+// и CRC-32 своего содержимого. Append копит записи в памяти, группа
+// записывается в файл одним write() (и одним fsync по политике).
+// Записи, не дошедшие до файла, при падении теряются; дольше
+// group_commit_delay они в памяти не задерживаются.
+// Методы можно вызывать из разных потоков.
+class WriteAheadLog {
+public:
+    // Открывает журнал для дописывания; повреждённый хвост файла должен
+    // быть отрезан заранее (ReplayWriteAheadLog делает это сам)
+    WriteAheadLog(const string& path, const WalOptions& options = WalOptions());
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+    // Останавливает фоновую запись и дописывает незафиксированные записи
+    ~WriteAheadLog();
+
+    // Ошибку фоновой записи получает следующий вызов Append или Commit.
+    // Если Append бросил исключение, его запись в журнал не попадает
+    void Append(const WalRecord& record);
+    void Commit();
+    // Удаляет все записи, например после сохранения снимка
+    void Reset();
+
+    WalStats GetStats() const;
+
+private:
+    string path_;
+    WalOptions options_;
+    int file_descriptor_ = -1;
+    // Файл дописывается только под log_mutex_, поэтому размер известен без fstat
+    uint64_t file_size_ = 0;
+    mutable mutex log_mutex_;
+    condition_variable flush_condition_;
+    string pending_;
+    size_t pending_records_ = 0;
+    chrono::steady_clock::time_point oldest_pending_;
+    WalStats stats_;
+    exception_ptr flush_error_;
+    bool stop_flushing_ = false;
+    // Запускается при первой записи, которую может понадобиться записать по сроку
+    thread flush_thread_;
+
+    // Вызываются под log_mutex_
+    void CommitPending();
+    void DropFailedRecord(uint64_t record_offset, size_t record_size);
+    void RethrowFlushError();
+    void WriteAll(string& data);
+    void Sync();
+    void FlushLoop();
+};
+
+struct WalReplayStats {
+    uint64_t records = 0;
+    uint64_t last_sequence = 0;
+    // Сколько байт недописанного или повреждённого хвоста отрезано
+    uint64_t truncated_bytes = 0;
+};
+
+// Передаёт записи журнала в порядке записи и отрезает хвост после первой
+// недописанной или повреждённой записи. Отсутствующий файл создаётся пустым.
+WalReplayStats ReplayWriteAheadLog(const string& path, const function<void(const WalRecord&)>& apply);
+
+// Записывает файл целиком через временный файл, fsync и rename:
+// после падения на диске остаётся либо старое, либо новое содержимое
+void WriteFileAtomically(const string& path, string_view data);